@@ -0,0 +1,221 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Reads a table of valid and invalid JSON documents with the streaming reader and checks the
+// errors, with their line and column. Then checks typed reads of values of the wrong type, the
+// errors of settings with wrong types, and a file larger than the reader's buffer.
+// Usage: json-reader-test
+
+#include <cstdio>
+#include <string>
+
+#include "json_reader.h"
+#include "settings.h"
+
+struct DocumentCase {
+    const char* json;
+    /// Empty if the document is valid
+    const char* error;
+};
+
+enum class Read {
+    Bool,
+    Integer,
+    SmallInteger,
+    String,
+    Object,
+    Array,
+};
+
+struct TypedCase {
+    const char* json;
+    Read read;
+    const char* error;
+};
+
+struct OptionsCase {
+    const char* json;
+    const char* error;
+};
+
+constexpr DocumentCase document_cases[] = {
+    {R"({"a": [1, -2.5e3, {"b": null}], "c": "xé\n", "d": true, "e": {}})", ""},
+    {"  [ ]  \n", ""},
+    {R"("😀")", ""},
+    {"", "line 1, column 1: unexpected end of input"},
+    {R"({"a": 1,})", "line 1, column 9: expected a key"},
+    {R"({"a" 1})", "line 1, column 6: expected :"},
+    {R"({"a": 1 "b": 2})", "line 1, column 9: expected , or }"},
+    {"[1 2]", "line 1, column 4: expected , or ]"},
+    {"[1, 2", "line 1, column 6: expected , or ]"},
+    {R"({"a": [1, 2)", "line 1, column 12: expected , or ]"},
+    {R"({"a": "abc)", "line 1, column 7: unterminated string"},
+    {"{\n  \"a\": tru\n}", "line 2, column 8: invalid literal"},
+    {"{\n  \"a\": nul}", "line 2, column 8: invalid literal"},
+    {"{\n\n  \"a\": 01x}", "line 3, column 10: expected , or }"},
+    {"[-]", "line 1, column 2: invalid number"},
+    {"[1.]", "line 1, column 2: invalid number"},
+    {"[1e+]", "line 1, column 2: invalid number"},
+    {"[@]", "line 1, column 2: unexpected character"},
+    {"[1] 2", "line 1, column 5: unexpected data after the settings"},
+    {"\"a\tb\"", "line 1, column 1: control character in string"},
+    {R"("\x")", "line 1, column 1: invalid escape"},
+    {R"("\u12G4")", "line 1, column 1: invalid \\u escape"},
+    {R"("\ud83d")", "line 1, column 1: invalid surrogate pair"},
+};
+
+constexpr TypedCase typed_cases[] = {
+    {"1", Read::Bool, "line 1, column 1: expected true or false"},
+    {"\"true\"", Read::Bool, "line 1, column 1: expected true or false"},
+    {"true", Read::Integer, "line 1, column 1: expected an integer"},
+    {"1.5", Read::Integer, "line 1, column 1: expected an integer"},
+    {"  -9223372036854775808", Read::Integer, ""},
+    {"9223372036854775808", Read::Integer, "line 1, column 1: integer out of range"},
+    {"99999999999999999999", Read::Integer, "line 1, column 1: integer out of range"},
+    {"65536", Read::SmallInteger, "line 1, column 1: expected an integer from 0 to 65535"},
+    {"-1", Read::SmallInteger, "line 1, column 1: expected an integer from 0 to 65535"},
+    {"5", Read::String, "line 1, column 1: expected a string"},
+    {"[]", Read::Object, "line 1, column 1: expected an object"},
+    {"\n {}", Read::Array, "line 2, column 2: expected an array"},
+};
+
+constexpr OptionsCase options_cases[] = {
+    {R"({"watch_settings_file": true,
+        "instrumentation": {"enabled": false, "output": "a.csv", "flush_interval_ms": 10}})",
+     ""},
+    {R"({"watch_settings_file": 1})", "line 1, column 25: expected true or false"},
+    {R"({"instrumentation": {"flush_interval_ms": 10}})",
+     "line 1, column 45: missing instrumentation.enabled"},
+    {R"({"instrumentation": {"output": 5}})", "line 1, column 32: expected a string"},
+    {R"({"profiles": []})", "line 1, column 14: expected an object"},
+    {R"({"layout_packs": "pack.json"})", "line 1, column 18: expected an array"},
+};
+
+static int failure_count = 0;
+
+static void CheckError(const std::string& json, const std::string& error,
+                       const std::string& expected) {
+    if (error != expected) {
+        std::fprintf(stderr, "failed: %s: error \"%s\" instead of \"%s\"\n", json.c_str(),
+                     error.c_str(), expected.c_str());
+        ++failure_count;
+    }
+}
+
+// Reads any document, strings and booleans with their typed reads
+static bool ReadValue(JsonReader& reader) {
+    std::string key;
+    bool done;
+    switch (reader.PeekType()) {
+    case JsonReader::Type::Object:
+        if (!reader.BeginObject()) {
+            return false;
+        }
+        while (reader.NextMember(key, done) && !done) {
+            if (!ReadValue(reader)) {
+                return false;
+            }
+        }
+        return !reader.HasFailed();
+    case JsonReader::Type::Array:
+        if (!reader.BeginArray()) {
+            return false;
+        }
+        while (reader.NextElement(done) && !done) {
+            if (!ReadValue(reader)) {
+                return false;
+            }
+        }
+        return !reader.HasFailed();
+    case JsonReader::Type::String:
+        return reader.ReadString(key);
+    case JsonReader::Type::Bool:
+        return reader.ReadBool(done);
+    default:
+        return reader.SkipValue();
+    }
+}
+
+static bool ReadTyped(JsonReader& reader, Read read) {
+    bool value;
+    s64 integer;
+    std::string string;
+    switch (read) {
+    case Read::Bool:
+        return reader.ReadBool(value);
+    case Read::Integer:
+        return reader.ReadInteger(integer);
+    case Read::SmallInteger:
+        return reader.ReadInteger(integer, 0, 65535);
+    case Read::String:
+        return reader.ReadString(string);
+    case Read::Object:
+        return reader.BeginObject();
+    case Read::Array:
+        return reader.BeginArray();
+    }
+    return false;
+}
+
+// Every later call fails once a call failed
+static void CheckFailureSticks(JsonReader& reader, const std::string& json) {
+    bool value;
+    if (reader.HasFailed() && (reader.ReadBool(value) || reader.SkipValue() || reader.End())) {
+        std::fprintf(stderr, "failed: %s: a call succeeded after an error\n", json.c_str());
+        ++failure_count;
+    }
+}
+
+// A document larger than the reader's buffer, with an error after the first refill
+static void CheckFile() {
+    std::FILE* file = std::tmpfile();
+    if (file == nullptr) {
+        std::fprintf(stderr, "failed: can't create a temporary file\n");
+        ++failure_count;
+        return;
+    }
+    const std::string long_string(JsonReader::BUFFER_SIZE + 100, 'a');
+    std::fprintf(file, "[\n\"%s\",\n  x]", long_string.c_str());
+    std::rewind(file);
+    JsonReader reader(file);
+    ReadValue(reader);
+    CheckError("a large file", reader.GetError(), "line 3, column 3: unexpected character");
+    std::fclose(file);
+}
+
+int main() {
+    for (const DocumentCase& test : document_cases) {
+        const std::string json = test.json;
+        JsonReader reader(json.data(), json.size());
+        if (ReadValue(reader)) {
+            reader.End();
+        }
+        CheckError(json, reader.GetError(), test.error);
+        CheckFailureSticks(reader, json);
+    }
+
+    for (const TypedCase& test : typed_cases) {
+        const std::string json = test.json;
+        JsonReader reader(json.data(), json.size());
+        ReadTyped(reader, test.read);
+        CheckError(json, reader.GetError(), test.error);
+        CheckFailureSticks(reader, json);
+    }
+
+    for (const OptionsCase& test : options_cases) {
+        const std::string json = test.json;
+        Settings settings;
+        std::string error;
+        ParseOptions(json.data(), json.size(), settings, error);
+        CheckError(json, error, test.error);
+    }
+
+    CheckFile();
+
+    if (failure_count != 0) {
+        return 1;
+    }
+    std::printf("JSON reader errors passed\n");
+    return 0;
+}
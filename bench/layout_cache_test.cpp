@@ -0,0 +1,220 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Writes the layout cache of a settings file, then checks which changes to the settings file keep
+// it, and that corrupt copies of it are rejected rather than read out of bounds. Then checks that
+// names out of order are rejected, with the cache of synthetic named layouts.
+// Usage: layout-cache-test SETTINGS FOLDER (SETTINGS is copied to the existing FOLDER)
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "file_util.h"
+#include "layout_cache.h"
+#include "layout_expression.h"
+#include "settings.h"
+#include "synthetic_settings.h"
+
+static int failure_count = 0;
+
+static void Check(bool condition, const char* description) {
+    if (!condition) {
+        std::fprintf(stderr, "failed: %s\n", description);
+        ++failure_count;
+    }
+}
+
+static void WriteFile(const std::string& path, const std::vector<u8>& contents) {
+    std::FILE* file = FileUtil::OpenFile(path, "wb");
+    std::fwrite(contents.data(), 1, contents.size(), file);
+    std::fclose(file);
+}
+
+static bool ReadCache(const std::string& cache_path, const std::string& path) {
+    FileUtil::FileStamp stamp;
+    Settings settings;
+    return FileUtil::GetFileStamp(path, stamp) &&
+           ReadLayoutCache(cache_path, path, stamp, settings);
+}
+
+static LayoutCacheHeader GetHeader(const std::vector<u8>& cache) {
+    LayoutCacheHeader header;
+    std::memcpy(&header, cache.data(), sizeof(header));
+    return header;
+}
+
+static CustomLayout GetLayout(const std::vector<u8>& cache, std::size_t index) {
+    CustomLayout layout;
+    std::memcpy(&layout, cache.data() + sizeof(LayoutCacheHeader) + index * sizeof(layout),
+                sizeof(layout));
+    return layout;
+}
+
+static void SetLayout(std::vector<u8>& cache, std::size_t index, const CustomLayout& layout) {
+    std::memcpy(cache.data() + sizeof(LayoutCacheHeader) + index * sizeof(layout), &layout,
+                sizeof(layout));
+}
+
+// The first layout with expressions
+static std::size_t FindExpressionLayout(const std::vector<u8>& cache) {
+    for (std::size_t i = 0; i < GetHeader(cache).layout_count; ++i) {
+        if (GetLayout(cache, i).expression_mask != 0) {
+            return i;
+        }
+    }
+    return static_cast<std::size_t>(-1);
+}
+
+static void SetCodeWord(std::vector<u8>& cache, std::size_t position, u32 word) {
+    const LayoutCacheHeader header = GetHeader(cache);
+    std::memcpy(cache.data() + sizeof(header) + header.layout_count * sizeof(CustomLayout) +
+                    position * sizeof(u32),
+                &word, sizeof(word));
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: layout-cache-test SETTINGS FOLDER\n");
+        return 1;
+    }
+    const std::string path = std::string(argv[2]) + "/layout-cache-test.json";
+    const std::string cache_path = GetLayoutCachePath(path);
+    std::vector<u8> contents;
+    if (!FileUtil::ReadFile(argv[1], contents)) {
+        std::fprintf(stderr, "failed to read %s\n", argv[1]);
+        return 1;
+    }
+    WriteFile(path, contents);
+    std::remove(cache_path.c_str());
+
+    Settings parsed;
+    std::string error;
+    if (!LoadSettings(path, parsed, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    Check(ReadCache(cache_path, path), "loading the settings writes a cache");
+
+    // Touched without changing its contents
+    const auto modification_time = std::filesystem::last_write_time(path);
+    std::filesystem::last_write_time(path, modification_time + std::chrono::hours(1));
+    FileUtil::FileStamp stamp;
+    FileUtil::GetFileStamp(path, stamp);
+    Check(ReadCache(cache_path, path), "a touched settings file keeps its cache");
+    std::vector<u8> cache;
+    FileUtil::ReadFile(cache_path, cache);
+    Check(GetHeader(cache).settings_modification_time == stamp.modification_time,
+          "the cache is updated with the new modification time");
+
+    // Same size, other contents
+    std::vector<u8> edited = contents;
+    const std::size_t digit = std::string(edited.begin(), edited.end()).find("800");
+    edited[digit] = '9';
+    WriteFile(path, edited);
+    std::filesystem::last_write_time(path, modification_time + std::chrono::hours(2));
+    Check(!ReadCache(cache_path, path), "an edited settings file of the same size is reparsed");
+
+    WriteFile(path, contents);
+    std::remove(cache_path.c_str());
+    Settings reparsed;
+    LoadSettings(path, reparsed, error);
+    cache.clear();
+    FileUtil::ReadFile(cache_path, cache);
+    const std::size_t expression_layout = FindExpressionLayout(cache);
+    if (GetHeader(cache).layout_count == 0 || expression_layout == static_cast<std::size_t>(-1)) {
+        std::fprintf(stderr, "%s needs a layout with an expression\n", argv[1]);
+        return 1;
+    }
+
+    struct Corruption {
+        const char* description;
+        std::function<void(std::vector<u8>&)> apply;
+    };
+    const Corruption corruptions[] = {
+        {"a truncated cache", [](std::vector<u8>& bytes) { bytes.pop_back(); }},
+        {"a name outside of the names",
+         [](std::vector<u8>& bytes) {
+             CustomLayout layout = GetLayout(bytes, 0);
+             layout.name_offset = 0xFFFFFF00;
+             layout.name_length = 0x200;
+             SetLayout(bytes, 0, layout);
+         }},
+        {"expressions outside of the expression code",
+         [expression_layout](std::vector<u8>& bytes) {
+             CustomLayout layout = GetLayout(bytes, expression_layout);
+             layout.expression_code = GetHeader(bytes).expression_code_size;
+             SetLayout(bytes, expression_layout, layout);
+         }},
+        {"an expression of a value that doesn't exist",
+         [](std::vector<u8>& bytes) {
+             CustomLayout layout = GetLayout(bytes, 0);
+             layout.expression_mask |= 1 << LAYOUT_VALUE_COUNT;
+             SetLayout(bytes, 0, layout);
+         }},
+        {"more expressions than the expression code holds",
+         [expression_layout](std::vector<u8>& bytes) {
+             CustomLayout layout = GetLayout(bytes, expression_layout);
+             layout.expression_mask = (1 << LAYOUT_VALUE_COUNT) - 1;
+             SetLayout(bytes, expression_layout, layout);
+         }},
+        {"an invalid op code",
+         [expression_layout](std::vector<u8>& bytes) {
+             SetCodeWord(bytes, GetLayout(bytes, expression_layout).expression_code, 0xFF);
+         }},
+        {"an expression without an end",
+         [](std::vector<u8>& bytes) {
+             for (std::size_t i = 0; i < GetHeader(bytes).expression_code_size; ++i) {
+                 SetCodeWord(bytes, i,
+                             static_cast<u32>(LayoutExpression::OpCode::Negate));
+             }
+         }},
+    };
+    for (const Corruption& corruption : corruptions) {
+        std::vector<u8> corrupt = cache;
+        corruption.apply(corrupt);
+        WriteFile(cache_path, corrupt);
+        if (ReadCache(cache_path, path)) {
+            std::fprintf(stderr, "failed: %s was read\n", corruption.description);
+            ++failure_count;
+        }
+    }
+    WriteFile(cache_path, cache);
+    Check(ReadCache(cache_path, path), "the valid cache is read");
+
+    std::remove(path.c_str());
+    std::remove(cache_path.c_str());
+
+    // Both names in bounds, but LayoutPrograms takes them to be in layout order
+    const std::string named_path = std::string(argv[2]) + "/layout-cache-test-names.json";
+    const std::string named_cache_path = GetLayoutCachePath(named_path);
+    WriteSyntheticSettings(named_path, 2);
+    std::remove(named_cache_path.c_str());
+    Settings named;
+    LoadSettings(named_path, named, error);
+    std::vector<u8> named_cache;
+    FileUtil::ReadFile(named_cache_path, named_cache);
+    Check(ReadCache(named_cache_path, named_path), "the cache of named layouts is read");
+    CustomLayout first = GetLayout(named_cache, 0);
+    CustomLayout second = GetLayout(named_cache, 1);
+    std::swap(first.name_offset, second.name_offset);
+    SetLayout(named_cache, 0, first);
+    SetLayout(named_cache, 1, second);
+    WriteFile(named_cache_path, named_cache);
+    Check(!ReadCache(named_cache_path, named_path), "names out of order are rejected");
+
+    std::remove(named_path.c_str());
+    std::remove(named_cache_path.c_str());
+
+    if (failure_count != 0) {
+        return 1;
+    }
+    std::printf("layout cache checks passed\n");
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Compiles and evaluates a table of layout expressions, and checks the errors of invalid ones.
+// Usage: layout-expression-test
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "layout_expression.h"
+
+struct ValueCase {
+    const char* source;
+    double expected;
+};
+
+struct ErrorCase {
+    const char* source;
+    /// The end of the error, after "invalid expression \"source\": "
+    const char* message;
+};
+
+// width 800, height 600
+constexpr ValueCase value_cases[] = {
+    {"1 + 2 * 3", 7},
+    {"(1 + 2) * 3", 9},
+    {"10 - 4 - 3", 3},
+    {"16 / 4 / 2", 2},
+    {"2 * 3 % 4", 2},
+    {"-2 * -3", 6},
+    {"--2 + +2", 4},
+    {"-(1 + 2) * 2", -6},
+    {"width / 2", 400},
+    {"height - width", -200},
+    {"min(height * top_aspect, width)", 800},
+    {"max(width / 2, height)", 600},
+    {"floor(2.5) + ceil(2.5) + round(2.5) + abs(-1)", 9},
+    {"min(max(1, 2), 3) * (width % 300)", 400},
+    {".5 * 4", 2},
+    {"1e3 + 1", 1001},
+    // Not representable as a f32
+    {"16777217", 16777217},
+    {"4294967297 - 4294967296", 1},
+    {"  width\t*\n2  ", 1600},
+    {"1 / 0", INFINITY},
+    {"-1 / 0", -INFINITY},
+};
+
+constexpr ErrorCase error_cases[] = {
+    {"", "unexpected end"},
+    {"1 +", "unexpected end"},
+    {"(1 + 2", "expected )"},
+    {"1 2", "unexpected 2"},
+    {"1 + )", "unexpected )"},
+    {"depth", "unknown name depth"},
+    {"Width", "unknown name Width"},
+    {"min 1", "expected ( after min"},
+    {"min(1)", "expected , in min"},
+    {"abs(1, 2)", "expected ) after the arguments of abs"},
+    {"floor()", "unexpected )"},
+    {"2 ^ 3", "unexpected ^ 3"},
+    {"#", "unexpected #"},
+};
+
+static int failure_count = 0;
+
+static void Fail(const std::string& source, const std::string& message) {
+    std::fprintf(stderr, "failed: \"%s\": %s\n", source.c_str(), message.c_str());
+    ++failure_count;
+}
+
+static const double variables[] = {800, 600, 5.0 / 3.0, 4.0 / 3.0};
+static_assert(sizeof(variables) / sizeof(variables[0]) ==
+              static_cast<std::size_t>(LayoutExpression::Variable::Count));
+
+// Compiles after existing code, like layouts sharing one bytecode vector
+static void CheckValue(const std::string& source, double expected) {
+    std::vector<u32> code{0xFFFFFFFF};
+    std::string error;
+    if (!LayoutExpression::Compile(source, code, error)) {
+        Fail(source, error);
+        return;
+    }
+    const u32* next;
+    const double value = LayoutExpression::Evaluate(code.data() + 1, variables, &next);
+    if (!(value == expected || (std::isnan(value) && std::isnan(expected)))) {
+        Fail(source, "evaluated to " + std::to_string(value) + " instead of " +
+                         std::to_string(expected));
+    }
+    if (next != code.data() + code.size() || LayoutExpression::Skip(code.data() + 1) != next ||
+        LayoutExpression::Validate(code.data() + 1, next) != next) {
+        Fail(source, "evaluating, skipping or validating it doesn't stop after its end");
+    }
+}
+
+static void CheckError(const std::string& source, const std::string& message) {
+    std::vector<u32> code{0xFFFFFFFF};
+    std::string error;
+    if (LayoutExpression::Compile(source, code, error)) {
+        Fail(source, "compiled");
+        return;
+    }
+    const std::string expected = "invalid expression \"" + source + "\": " + message;
+    if (error != expected) {
+        Fail(source, "error \"" + error + "\" instead of \"" + expected + "\"");
+    }
+    if (code.size() != 1) {
+        Fail(source, "left bytecode behind");
+    }
+}
+
+// 1 + (1 + (1 + ...)) keeps count values on the stack
+static std::string NestedSum(std::size_t count) {
+    std::string source = "1";
+    for (std::size_t i = 1; i < count; ++i) {
+        source = "1 + (" + source + ")";
+    }
+    return source;
+}
+
+int main() {
+    for (const ValueCase& test : value_cases) {
+        CheckValue(test.source, test.expected);
+    }
+    CheckValue("0 / 0", NAN);
+    CheckValue("width % 0", NAN);
+    for (const ErrorCase& test : error_cases) {
+        CheckError(test.source, test.message);
+    }
+
+    CheckValue(NestedSum(LayoutExpression::MAX_STACK_DEPTH),
+               static_cast<double>(LayoutExpression::MAX_STACK_DEPTH));
+    CheckError(NestedSum(LayoutExpression::MAX_STACK_DEPTH + 1), "too complex");
+
+    if (failure_count != 0) {
+        return 1;
+    }
+    std::printf("layout expressions passed\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Compares loading synthetic settings files the way the plugin used to (an nlohmann::json
+// document built from a copy of the file), with the streaming parser, and with the layout cache.
+// Then compares parsing layout packs one after the other with loading them from a settings file,
+// which parses them in parallel and drops duplicates.
+// Usage: load-benchmark [folder for the temporary files]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "layout_cache.h"
+#include "settings.h"
+#include "synthetic_settings.h"
+
+static std::size_t ParseWithDocument(const std::string& path) {
+    std::ifstream file(path);
+    std::ostringstream oss;
+    oss << file.rdbuf();
+
+    const nlohmann::json json = nlohmann::json::parse(oss.str());
+    std::vector<CustomLayout> layouts;
+    for (const nlohmann::json& json_layout : json["layouts"]) {
+        CustomLayout custom_layout{};
+        custom_layout.top_screen = CustomLayout::Screen{
+            json_layout["top_screen"]["left"].get<u16>(),
+            json_layout["top_screen"]["top"].get<u16>(),
+            json_layout["top_screen"]["right"].get<u16>(),
+            json_layout["top_screen"]["bottom"].get<u16>(),
+        };
+        custom_layout.bottom_screen = CustomLayout::Screen{
+            json_layout["bottom_screen"]["left"].get<u16>(),
+            json_layout["bottom_screen"]["top"].get<u16>(),
+            json_layout["bottom_screen"]["right"].get<u16>(),
+            json_layout["bottom_screen"]["bottom"].get<u16>(),
+        };
+        if (json_layout.count("resize_window")) {
+            custom_layout.resize_window = CustomLayout::ResizeWindow{
+                json_layout["resize_window"]["enabled"].get<bool>(),
+                json_layout["resize_window"]["width"].get<int>(),
+                json_layout["resize_window"]["height"].get<int>(),
+            };
+        }
+        if (json_layout.count("move_window")) {
+            custom_layout.move_window = CustomLayout::MoveWindow{
+                json_layout["move_window"]["enabled"].get<bool>(),
+                json_layout["move_window"]["x"].get<int>(),
+                json_layout["move_window"]["y"].get<int>(),
+            };
+        }
+        if (json_layout.count("upright")) {
+            custom_layout.upright = json_layout["upright"].get<bool>();
+        }
+        layouts.push_back(custom_layout);
+    }
+    return layouts.size();
+}
+
+template <typename Function>
+static double MedianMilliseconds(int runs, Function function) {
+    std::vector<double> times;
+    for (int i = 0; i < runs; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Every synthetic pack has the same 1000 different layouts, named differently
+static bool RunLayoutPacks(const std::string& folder) {
+    constexpr std::size_t PACK_COUNT = 16;
+    constexpr std::size_t LAYOUTS_PER_PACK = 10000;
+    constexpr std::size_t UNIQUE_LAYOUT_COUNT = 1000;
+
+    const std::string path = folder + "/load-benchmark-packs.json";
+    std::vector<std::string> pack_paths;
+    {
+        std::ofstream file(path, std::ios::trunc);
+        file << "{\n  \"layout_packs\": [";
+        for (std::size_t i = 0; i < PACK_COUNT; ++i) {
+            pack_paths.push_back(folder + "/load-benchmark-pack-" + std::to_string(i) + ".json");
+            WriteSyntheticSettings(pack_paths.back(), LAYOUTS_PER_PACK);
+            file << (i == 0 ? "" : ", ") << "\"load-benchmark-pack-" << i << ".json\"";
+        }
+        file << "],\n  \"layouts\": []\n}\n";
+    }
+
+    std::string error;
+    bool ok = true;
+    const double sequential = MedianMilliseconds(5, [&] {
+        std::vector<CustomLayout> layouts;
+        std::vector<u32> expression_code;
+        std::vector<char> names;
+        for (const std::string& pack_path : pack_paths) {
+            ok &= ParseLayoutPack(pack_path, layouts, expression_code, names, error);
+        }
+        ok &= layouts.size() == PACK_COUNT * LAYOUTS_PER_PACK;
+    });
+
+    u32 duplicate_count = 0;
+    const double load = MedianMilliseconds(5, [&] {
+        Settings settings;
+        ok &= LoadSettings(path, settings, error) &&
+              settings.layouts.size() == UNIQUE_LAYOUT_COUNT;
+        duplicate_count = 0;
+        for (const LayoutPackReport& report : settings.layout_pack_reports) {
+            ok &= report.error.empty();
+            duplicate_count += report.duplicate_count;
+        }
+    });
+
+    for (const std::string& pack_path : pack_paths) {
+        std::remove(pack_path.c_str());
+    }
+    std::remove(path.c_str());
+    std::remove(GetLayoutCachePath(path).c_str());
+    if (!ok) {
+        std::fprintf(stderr, "loading layout packs failed: %s\n", error.c_str());
+        return false;
+    }
+
+    std::printf("\n%zu packs of %zu layouts: parsed one after the other %.3f ms, loaded %.3f ms "
+                "(%zu layouts, %u duplicates dropped)\n",
+                PACK_COUNT, LAYOUTS_PER_PACK, sequential, load, UNIQUE_LAYOUT_COUNT,
+                duplicate_count);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const std::string folder = argc > 1 ? argv[1] : ".";
+    const std::string path = folder + "/load-benchmark-settings.json";
+    const std::string cache_path = GetLayoutCachePath(path);
+
+    std::printf("%10s %12s %14s %14s %14s %14s\n", "layouts", "json bytes", "document ms",
+                "stream ms", "stream+write ms", "cache ms");
+
+    for (const std::size_t layout_count : {10, 100, 1000, 10000, 100000}) {
+        WriteSyntheticSettings(path, layout_count);
+        const int runs = layout_count >= 10000 ? 5 : 21;
+        std::string error;
+        bool ok = true;
+
+        const double document = MedianMilliseconds(runs, [&] {
+            ok &= ParseWithDocument(path) == layout_count;
+        });
+
+        const double parse = MedianMilliseconds(runs, [&] {
+            Settings settings;
+            ok &= ParseSettings(path, settings, error) && settings.layouts.size() == layout_count;
+        });
+
+        const double parse_and_write = MedianMilliseconds(runs, [&] {
+            std::remove(cache_path.c_str());
+            Settings settings;
+            ok &= LoadSettings(path, settings, error);
+        });
+
+        const double cache = MedianMilliseconds(runs, [&] {
+            Settings settings;
+            ok &= LoadSettings(path, settings, error) && settings.layouts.size() == layout_count;
+        });
+
+        if (!ok) {
+            std::fprintf(stderr, "loading failed: %s\n", error.c_str());
+            return 1;
+        }
+
+        FileUtil::FileStamp stamp;
+        FileUtil::GetFileStamp(path, stamp);
+        std::printf("%10zu %12llu %14.3f %14.3f %14.3f %14.3f\n", layout_count,
+                    static_cast<unsigned long long>(stamp.size), document, parse, parse_and_write,
+                    cache);
+    }
+
+    std::remove(path.c_str());
+    std::remove(cache_path.c_str());
+    return RunLayoutPacks(folder) ? 0 : 1;
+}
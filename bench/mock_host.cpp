@@ -0,0 +1,278 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <list>
+
+#include "mock_host.h"
+
+namespace MockHost {
+
+namespace {
+
+// Button states and call counts are atomics, as the plugin's input polling thread samples buttons
+struct ButtonDevice {
+    std::string params;
+    std::atomic<bool> pressed{false};
+};
+
+std::list<ButtonDevice> button_devices;
+std::vector<Call> calls;
+std::array<std::atomic<u64>, static_cast<std::size_t>(Function::Count)> call_counts{};
+std::array<u64, static_cast<std::size_t>(Function::Count)> call_costs{};
+bool recording = false;
+bool menus_open = false;
+std::string clicked_menu_item;
+
+constexpr std::array<const char*, static_cast<std::size_t>(Function::Count)> names = {
+    "vvctre_settings_set_custom_layout_top_left",
+    "vvctre_settings_set_custom_layout_top_top",
+    "vvctre_settings_set_custom_layout_top_right",
+    "vvctre_settings_set_custom_layout_top_bottom",
+    "vvctre_settings_set_custom_layout_bottom_left",
+    "vvctre_settings_set_custom_layout_bottom_top",
+    "vvctre_settings_set_custom_layout_bottom_right",
+    "vvctre_settings_set_custom_layout_bottom_bottom",
+    "vvctre_button_device_new",
+    "vvctre_button_device_get_state",
+    "vvctre_settings_apply",
+    "vvctre_settings_set_use_custom_layout",
+    "vvctre_set_os_window_size",
+    "vvctre_set_os_window_position",
+    "vvctre_settings_set_upright_screens",
+    "vvctre_gui_begin_menu",
+    "vvctre_gui_end_menu",
+    "vvctre_gui_menu_item",
+    "vvctre_button_device_delete",
+    "vvctre_settings_set_custom_layout",
+};
+
+void Spin(u64 nanoseconds) {
+    const auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(nanoseconds);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+void OnCall(Function function, s64 first_argument = 0, s64 second_argument = 0,
+            const char* text = nullptr) {
+    const std::size_t index = static_cast<std::size_t>(function);
+    // Not a locked increment, as only one thread at a time calls a given function
+    call_counts[index].store(call_counts[index].load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+    if (recording && function != Function::ButtonDeviceGetState) {
+        calls.push_back(Call{function, first_argument, second_argument, text ? text : ""});
+    }
+    if (call_costs[index] != 0) {
+        Spin(call_costs[index]);
+    }
+}
+
+template <Function function>
+void SetU16(u16 value) {
+    OnCall(function, value);
+}
+
+void* ButtonDeviceNew(void* plugin_manager, const char* params) {
+    OnCall(Function::ButtonDeviceNew, 0, 0, params);
+    button_devices.emplace_back().params = params;
+    return &button_devices.back();
+}
+
+bool ButtonDeviceGetState(void* device) {
+    OnCall(Function::ButtonDeviceGetState);
+    return static_cast<ButtonDevice*>(device)->pressed.load(std::memory_order_relaxed);
+}
+
+void SettingsApply() {
+    OnCall(Function::SettingsApply);
+}
+
+void SetUseCustomLayout(bool value) {
+    OnCall(Function::SetUseCustomLayout, value);
+}
+
+void SetOsWindowSize(void* plugin_manager, int width, int height) {
+    OnCall(Function::SetOsWindowSize, width, height);
+}
+
+void SetOsWindowPosition(void* plugin_manager, int x, int y) {
+    OnCall(Function::SetOsWindowPosition, x, y);
+}
+
+void SetUprightScreens(bool value) {
+    OnCall(Function::SetUprightScreens, value);
+}
+
+bool GuiBeginMenu(const char* label) {
+    OnCall(Function::GuiBeginMenu, 0, 0, label);
+    return menus_open;
+}
+
+void GuiEndMenu() {
+    OnCall(Function::GuiEndMenu);
+}
+
+bool GuiMenuItem(const char* label) {
+    OnCall(Function::GuiMenuItem, 0, 0, label);
+    if (!clicked_menu_item.empty() && clicked_menu_item == label) {
+        clicked_menu_item.clear();
+        return true;
+    }
+    return false;
+}
+
+void ButtonDeviceDelete(void* plugin_manager, void* device) {
+    OnCall(Function::ButtonDeviceDelete, 0, 0, static_cast<ButtonDevice*>(device)->params.c_str());
+    button_devices.remove_if([device](const ButtonDevice& d) { return &d == device; });
+}
+
+void SetCustomLayout(u16 top_left, u16 top_top, u16 top_right, u16 top_bottom, u16 bottom_left,
+                     u16 bottom_top, u16 bottom_right, u16 bottom_bottom) {
+    // Only formatted when recorded, so the cost of switches doesn't depend on it
+    char values[64] = {};
+    if (recording) {
+        std::snprintf(values, sizeof(values), "%u %u %u %u %u %u %u %u", top_left, top_top,
+                      top_right, top_bottom, bottom_left, bottom_top, bottom_right, bottom_bottom);
+    }
+    OnCall(Function::SetCustomLayout, 0, 0, values);
+}
+
+const std::array<void*, static_cast<std::size_t>(Function::Count)> functions = {
+    reinterpret_cast<void*>(&SetU16<Function::SetCustomLayoutTopLeft>),
+    reinterpret_cast<void*>(&SetU16<Function::SetCustomLayoutTopTop>),
+    reinterpret_cast<void*>(&SetU16<Function::SetCustomLayoutTopRight>),
+    reinterpret_cast<void*>(&SetU16<Function::SetCustomLayoutTopBottom>),
+    reinterpret_cast<void*>(&SetU16<Function::SetCustomLayoutBottomLeft>),
+    reinterpret_cast<void*>(&SetU16<Function::SetCustomLayoutBottomTop>),
+    reinterpret_cast<void*>(&SetU16<Function::SetCustomLayoutBottomRight>),
+    reinterpret_cast<void*>(&SetU16<Function::SetCustomLayoutBottomBottom>),
+    reinterpret_cast<void*>(&ButtonDeviceNew),
+    reinterpret_cast<void*>(&ButtonDeviceGetState),
+    reinterpret_cast<void*>(&SettingsApply),
+    reinterpret_cast<void*>(&SetUseCustomLayout),
+    reinterpret_cast<void*>(&SetOsWindowSize),
+    reinterpret_cast<void*>(&SetOsWindowPosition),
+    reinterpret_cast<void*>(&SetUprightScreens),
+    reinterpret_cast<void*>(&GuiBeginMenu),
+    reinterpret_cast<void*>(&GuiEndMenu),
+    reinterpret_cast<void*>(&GuiMenuItem),
+    reinterpret_cast<void*>(&ButtonDeviceDelete),
+    reinterpret_cast<void*>(&SetCustomLayout),
+};
+
+} // Anonymous namespace
+
+const char* GetName(Function function) {
+    return names[static_cast<std::size_t>(function)];
+}
+
+std::string FormatCall(const Call& call) {
+    std::string line = GetName(call.function);
+    switch (call.function) {
+    case Function::ButtonDeviceNew:
+    case Function::ButtonDeviceDelete:
+    case Function::GuiBeginMenu:
+    case Function::GuiMenuItem:
+    case Function::SetCustomLayout:
+        line += ' ';
+        line += call.text;
+        break;
+    case Function::SetOsWindowSize:
+    case Function::SetOsWindowPosition:
+        line += ' ' + std::to_string(call.first_argument) + ' ' +
+                std::to_string(call.second_argument);
+        break;
+    case Function::SettingsApply:
+    case Function::GuiEndMenu:
+    case Function::ButtonDeviceGetState:
+    case Function::Count:
+        break;
+    default:
+        line += ' ' + std::to_string(call.first_argument);
+        break;
+    }
+    return line;
+}
+
+void Reset() {
+    button_devices.clear();
+    calls.clear();
+    for (std::atomic<u64>& count : call_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    call_costs.fill(0);
+    recording = false;
+    menus_open = false;
+    clicked_menu_item.clear();
+}
+
+bool GetFunctions(const char** requested_names, int count, void** requested_functions) {
+    for (int i = 0; i < count; ++i) {
+        bool found = false;
+        for (std::size_t j = 0; j < names.size(); ++j) {
+            if (std::strcmp(requested_names[i], names[j]) == 0) {
+                requested_functions[i] = functions[j];
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SetRecording(bool recording_) {
+    recording = recording_;
+}
+
+const std::vector<Call>& GetCalls() {
+    return calls;
+}
+
+void ClearCalls() {
+    calls.clear();
+}
+
+u64 GetCallCount(Function function) {
+    return call_counts[static_cast<std::size_t>(function)].load(std::memory_order_relaxed);
+}
+
+void SetCallCost(Function function, u64 nanoseconds) {
+    call_costs[static_cast<std::size_t>(function)] = nanoseconds;
+}
+
+void SetButtonState(const std::string& params, bool pressed) {
+    for (ButtonDevice& device : button_devices) {
+        if (device.params == params) {
+            device.pressed.store(pressed, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::size_t GetButtonDeviceCount() {
+    return button_devices.size();
+}
+
+void SetMenusOpen(bool open) {
+    menus_open = open;
+}
+
+void ClickMenuItem(const std::string& label) {
+    clicked_menu_item = label;
+}
+
+} // namespace MockHost
+
+extern "C" void vvctre_settings_set_custom_layout(u16 top_left, u16 top_top, u16 top_right,
+                                                  u16 top_bottom, u16 bottom_left, u16 bottom_top,
+                                                  u16 bottom_right, u16 bottom_bottom) {
+    MockHost::SetCustomLayout(top_left, top_top, top_right, top_bottom, bottom_left, bottom_top,
+                              bottom_right, bottom_bottom);
+}
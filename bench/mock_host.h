@@ -0,0 +1,87 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common_types.h"
+
+/**
+ * A headless stand-in for vvctre. It implements every function the plugin requires, records the
+ * calls, lets button states be set, and can make any function take a given time.
+ * It also defines the optional vvctre_settings_set_custom_layout, which the plugin only finds if
+ * the executable exports it.
+ */
+namespace MockHost {
+
+enum class Function {
+    SetCustomLayoutTopLeft,
+    SetCustomLayoutTopTop,
+    SetCustomLayoutTopRight,
+    SetCustomLayoutTopBottom,
+    SetCustomLayoutBottomLeft,
+    SetCustomLayoutBottomTop,
+    SetCustomLayoutBottomRight,
+    SetCustomLayoutBottomBottom,
+    ButtonDeviceNew,
+    ButtonDeviceGetState,
+    SettingsApply,
+    SetUseCustomLayout,
+    SetOsWindowSize,
+    SetOsWindowPosition,
+    SetUprightScreens,
+    GuiBeginMenu,
+    GuiEndMenu,
+    GuiMenuItem,
+    ButtonDeviceDelete,
+    /// Optional, only found by the plugin in executables that export their symbols
+    SetCustomLayout,
+    Count,
+};
+
+struct Call {
+    Function function;
+    s64 first_argument;
+    s64 second_argument;
+    /// Parameters of vvctre_button_device_new, labels of menu functions, and the 8 values of
+    /// vvctre_settings_set_custom_layout
+    std::string text;
+};
+
+/// Returns the vvctre name of a function, for example vvctre_settings_apply.
+const char* GetName(Function function);
+
+/// Formats a call like a line of a golden file, for example vvctre_set_os_window_size 800 480.
+std::string FormatCall(const Call& call);
+
+/// Deletes the button devices and forgets the calls, call costs, and menu state.
+void Reset();
+
+/**
+ * Fills functions with the functions named by names, like vvctre does before PluginLoaded.
+ * Returns false if a name is unknown.
+ */
+bool GetFunctions(const char** names, int count, void** functions);
+
+/// Records calls when enabled, except for vvctre_button_device_get_state which would flood.
+void SetRecording(bool recording);
+const std::vector<Call>& GetCalls();
+void ClearCalls();
+u64 GetCallCount(Function function);
+
+/// Makes every call of a function spin for the given time, to simulate vvctre's work.
+void SetCallCost(Function function, u64 nanoseconds);
+
+/// Sets the state of every device created with these parameters.
+void SetButtonState(const std::string& params, bool pressed);
+std::size_t GetButtonDeviceCount();
+
+/// Makes vvctre_gui_begin_menu return open for every menu.
+void SetMenusOpen(bool open);
+/// Makes the next vvctre_gui_menu_item with this label return true.
+void ClickMenuItem(const std::string& label);
+
+} // namespace MockHost
@@ -0,0 +1,470 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Drives the plugin through its exported functions against the mock host, with synthetic settings
+// files of 10 to 100000 layouts, or an existing settings file. Every run happens in a child process
+// so it starts from a freshly loaded plugin.
+// Short presses are presses released before the next frame, counted with and without input polling.
+// Switches are also run with the live state published, while a thread reads it and checks every
+// snapshot against the synthetic layouts.
+// Startup is the time spent in PluginLoaded and InitialSettingsOpening. It's measured right after
+// PluginLoaded, like the settings were loaded before the settings were prefetched, and after
+// --startup-work-ms milliseconds standing in for what vvctre does between the two calls.
+// Usage: plugin-benchmark [plugin path] [--max-layouts N] [--apply-cost-us N] [--window-cost-us N]
+//                         [--startup-work-ms N] [--settings FILE]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "layout_cache.h"
+#include "live_state.h"
+#include "mock_host.h"
+#include "plugin_library.h"
+#include "settings.h"
+#include "synthetic_settings.h"
+
+struct Result {
+    bool ok = false;
+    char error[256] = {};
+    double startup_ms = 0;
+    double idle_frame_ns = 0;
+    double switch_us = 0;
+    double closed_menu_ns = 0;
+    double open_menu_ns = 0;
+    u64 short_presses_switched = 0;
+    u64 snapshots = 0;
+    u64 inconsistent_snapshots = 0;
+    u64 snapshot_retries = 0;
+    double host_calls_per_switch = 0;
+};
+
+struct Options {
+    std::string plugin_path;
+    std::size_t max_layouts = 100000;
+    u64 apply_cost_ns = 0;
+    u64 window_cost_ns = 0;
+    u32 startup_work_ms = 20;
+    std::string settings_file;
+};
+
+constexpr u64 SHORT_PRESSES = 10;
+constexpr const char* LIVE_STATE_FILE = "plugin-benchmark-live-state.bin";
+constexpr std::size_t LIVE_STATE_LAYOUTS = 1000;
+
+static double Elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+static void Fail(Result& result, const std::string& error) {
+    result.ok = false;
+    std::snprintf(result.error, sizeof(result.error), "%s", error.c_str());
+}
+
+// Opens the plugin and resets the mock host, functions receives what PluginLoaded needs
+static bool OpenPlugin(const Options& options, PluginLibrary& plugin, void* functions[64],
+                       Result& result) {
+    std::string error;
+    if (!plugin.Open(options.plugin_path, error)) {
+        Fail(result, error);
+        return false;
+    }
+
+    MockHost::Reset();
+    MockHost::SetCallCost(MockHost::Function::SettingsApply, options.apply_cost_ns);
+    MockHost::SetCallCost(MockHost::Function::SetOsWindowSize, options.window_cost_ns);
+
+    const int count = plugin.GetRequiredFunctionCount();
+    if (count > 64 || !MockHost::GetFunctions(plugin.GetRequiredFunctionNames(), count, functions)) {
+        Fail(result, "the plugin requires a function the mock host doesn't have");
+        return false;
+    }
+    return true;
+}
+
+static void Run(const Options& options, std::size_t layout_count, u32 startup_work_ms,
+                bool measure_frames, Result& result) {
+    PluginLibrary plugin;
+    void* functions[64];
+    if (!OpenPlugin(options, plugin, functions, result)) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    plugin.PluginLoaded(nullptr, nullptr, functions);
+    double startup_ns = Elapsed(start);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(startup_work_ms));
+
+    start = std::chrono::steady_clock::now();
+    plugin.InitialSettingsOpening();
+    startup_ns += Elapsed(start);
+    result.startup_ms = startup_ns / 1e6;
+    plugin.EmulationStarting();
+
+    if (MockHost::GetButtonDeviceCount() == 0) {
+        Fail(result, "no button device was created");
+        return;
+    }
+
+    result.ok = true;
+    if (!measure_frames) {
+        plugin.EmulatorClosing();
+        return;
+    }
+
+    constexpr int idle_frames = 200000;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < idle_frames; ++i) {
+        plugin.BeforeDrawingFPS();
+    }
+    result.idle_frame_ns = Elapsed(start) / idle_frames;
+
+    constexpr int switches = 2000;
+    const u64 applies_before = MockHost::GetCallCount(MockHost::Function::SettingsApply);
+    double switch_ns = 0;
+    for (int i = 0; i < switches; ++i) {
+        MockHost::SetButtonState(SYNTHETIC_BUTTON, true);
+        plugin.BeforeDrawingFPS();
+        MockHost::SetButtonState(SYNTHETIC_BUTTON, false);
+        start = std::chrono::steady_clock::now();
+        plugin.BeforeDrawingFPS();
+        switch_ns += Elapsed(start);
+    }
+    result.switch_us = switch_ns / switches / 1000.0;
+
+    // Every synthetic layout differs from the previous one, so every switch must apply once
+    const u64 applies = MockHost::GetCallCount(MockHost::Function::SettingsApply) - applies_before;
+    if (layout_count > 1 && applies != switches) {
+        Fail(result, std::to_string(applies) + " applies for " + std::to_string(switches) +
+                         " switches");
+        return;
+    }
+
+    constexpr int menu_frames = 100000;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < menu_frames; ++i) {
+        plugin.AddMenu();
+    }
+    result.closed_menu_ns = Elapsed(start) / menu_frames;
+
+    MockHost::SetMenusOpen(true);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < menu_frames; ++i) {
+        plugin.AddMenu();
+    }
+    result.open_menu_ns = Elapsed(start) / menu_frames;
+    MockHost::SetMenusOpen(false);
+
+    plugin.EmulatorClosing();
+}
+
+// Presses and releases the button between two frames, frames being 40 ms apart
+static void RunShortPresses(const Options& options, Result& result) {
+    PluginLibrary plugin;
+    void* functions[64];
+    if (!OpenPlugin(options, plugin, functions, result)) {
+        return;
+    }
+    plugin.PluginLoaded(nullptr, nullptr, functions);
+    plugin.InitialSettingsOpening();
+    plugin.EmulationStarting();
+    plugin.BeforeDrawingFPS();
+
+    const u64 applies_before = MockHost::GetCallCount(MockHost::Function::SettingsApply);
+    for (u64 i = 0; i < SHORT_PRESSES; ++i) {
+        MockHost::SetButtonState(SYNTHETIC_BUTTON, true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        MockHost::SetButtonState(SYNTHETIC_BUTTON, false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        plugin.BeforeDrawingFPS();
+    }
+    result.short_presses_switched =
+        MockHost::GetCallCount(MockHost::Function::SettingsApply) - applies_before;
+    result.ok = true;
+    plugin.EmulatorClosing();
+}
+
+// Calls that change the layout, vvctre_button_device_get_state aside
+static u64 CountHostCalls() {
+    u64 count = 0;
+    for (std::size_t i = 0; i < static_cast<std::size_t>(MockHost::Function::Count); ++i) {
+        const MockHost::Function function = static_cast<MockHost::Function>(i);
+        if (function != MockHost::Function::ButtonDeviceGetState) {
+            count += MockHost::GetCallCount(function);
+        }
+    }
+    return count;
+}
+
+// Returns whether a snapshot shows the synthetic layout it names, see WriteSyntheticSettings
+static bool IsSyntheticLayout(const LiveState::Snapshot& snapshot) {
+    if (snapshot.layout == LiveState::NO_LAYOUT) {
+        return true;
+    }
+    const u32 width = 400 + snapshot.layout % 1000;
+    const u32 height = 240 + snapshot.layout % 500;
+    const u32 flags = LiveState::CustomLayoutEnabled | LiveState::WindowSizeKnown |
+                      (snapshot.layout % 2 == 0 ? 0u : static_cast<u32>(LiveState::Upright));
+    return snapshot.flags == flags && snapshot.top_screen[0] == 0 && snapshot.top_screen[1] == 0 &&
+           snapshot.top_screen[2] == width && snapshot.top_screen[3] == height &&
+           snapshot.bottom_screen[0] == 40 && snapshot.bottom_screen[1] == height &&
+           snapshot.bottom_screen[2] == 360 && snapshot.bottom_screen[3] == height + 240 &&
+           snapshot.window[0] == static_cast<s32>(width) &&
+           snapshot.window[1] == static_cast<s32>(height + 240);
+}
+
+// Switches layouts with the live state published if publish is set, while a thread reads it
+static void RunLiveState(const Options& options, bool publish, Result& result) {
+    PluginLibrary plugin;
+    void* functions[64];
+    if (!OpenPlugin(options, plugin, functions, result)) {
+        return;
+    }
+    plugin.PluginLoaded(nullptr, nullptr, functions);
+    plugin.InitialSettingsOpening();
+    plugin.EmulationStarting();
+    plugin.BeforeDrawingFPS();
+
+    const LiveState::Shared* shared = nullptr;
+    if (publish) {
+        const std::string path = GetVvctreFolder() + LIVE_STATE_FILE;
+        const int fd = open(path.c_str(), O_RDONLY);
+        void* view = fd == -1 ? MAP_FAILED
+                              : mmap(nullptr, sizeof(LiveState::Shared), PROT_READ, MAP_SHARED,
+                                     fd, 0);
+        if (fd != -1) {
+            close(fd);
+        }
+        if (view == MAP_FAILED) {
+            Fail(result, "the live state wasn't published");
+            return;
+        }
+        shared = static_cast<const LiveState::Shared*>(view);
+    }
+
+    std::atomic<bool> stop{false};
+    std::thread reader;
+    if (shared != nullptr) {
+        reader = std::thread([&] {
+            LiveState::Snapshot snapshot;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (!LiveState::TryRead(*shared, snapshot)) {
+                    ++result.snapshot_retries;
+                    continue;
+                }
+                ++result.snapshots;
+                if (!IsSyntheticLayout(snapshot)) {
+                    ++result.inconsistent_snapshots;
+                }
+            }
+        });
+    }
+
+    constexpr int switches = 20000;
+    const u64 calls_before = CountHostCalls();
+    double switch_ns = 0;
+    for (int i = 0; i < switches; ++i) {
+        MockHost::SetButtonState(SYNTHETIC_BUTTON, true);
+        plugin.BeforeDrawingFPS();
+        MockHost::SetButtonState(SYNTHETIC_BUTTON, false);
+        const auto start = std::chrono::steady_clock::now();
+        plugin.BeforeDrawingFPS();
+        switch_ns += Elapsed(start);
+    }
+    result.switch_us = switch_ns / switches / 1000.0;
+    result.host_calls_per_switch = static_cast<double>(CountHostCalls() - calls_before) / switches;
+    stop = true;
+    if (reader.joinable()) {
+        reader.join();
+    }
+
+    plugin.EmulatorClosing();
+    result.ok = true;
+    if (shared != nullptr) {
+        LiveState::Snapshot snapshot;
+        if (!LiveState::TryRead(*shared, snapshot) || snapshot.layout != LiveState::NO_LAYOUT) {
+            Fail(result, "the live state still shows a layout after closing");
+        }
+        munmap(const_cast<LiveState::Shared*>(shared), sizeof(LiveState::Shared));
+    }
+}
+
+static Result RunInChild(const std::function<void(Result&)>& run) {
+    Result result;
+    int fds[2];
+    if (pipe(fds) != 0) {
+        Fail(result, "pipe failed");
+        return result;
+    }
+
+    // The child would print what's still buffered again
+    std::fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        run(result);
+        const ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == sizeof(result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    if (pid < 0 || read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+        Fail(result, "the benchmark process crashed");
+    }
+    close(fds[0]);
+    if (pid > 0) {
+        waitpid(pid, nullptr, 0);
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    options.plugin_path = GetVvctreFolder() + "cycle-custom-layouts.so";
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--max-layouts") == 0 && i + 1 < argc) {
+            options.max_layouts = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--apply-cost-us") == 0 && i + 1 < argc) {
+            options.apply_cost_ns = std::strtoull(argv[++i], nullptr, 10) * 1000;
+        } else if (std::strcmp(argv[i], "--window-cost-us") == 0 && i + 1 < argc) {
+            options.window_cost_ns = std::strtoull(argv[++i], nullptr, 10) * 1000;
+        } else if (std::strcmp(argv[i], "--startup-work-ms") == 0 && i + 1 < argc) {
+            options.startup_work_ms = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--settings") == 0 && i + 1 < argc) {
+            options.settings_file = argv[++i];
+        } else {
+            options.plugin_path = argv[i];
+        }
+    }
+
+    // The plugin reads its settings from the folder of the executable that loads it
+    const std::string settings_path = GetSettingsFilePath();
+    const std::string cache_path = GetLayoutCachePath(settings_path);
+
+    std::printf("%10s %16s %16s %16s %16s %14s %12s %14s %14s\n", "layouts", "cold startup ms",
+                "overlapped ms", "warm startup ms", "overlapped ms", "idle ns/frame", "switch us",
+                "menu ns", "open menu ns");
+
+    bool ok = true;
+    // Runs cold and warm, without and with the startup work. Frames are only measured with
+    // synthetic settings, as switches are checked against their layouts.
+    const auto run_settings = [&](const char* label, std::size_t layout_count, bool synthetic) {
+        Result results[4];
+        for (int i = 0; i < 4; ++i) {
+            const bool cold = i < 2;
+            const bool overlapped = i % 2 == 1;
+            if (cold) {
+                std::remove(cache_path.c_str());
+            }
+            const u32 startup_work_ms = overlapped ? options.startup_work_ms : 0;
+            const bool measure_frames = synthetic && i == 3;
+            results[i] = RunInChild([&](Result& result) {
+                Run(options, layout_count, startup_work_ms, measure_frames, result);
+            });
+            if (!results[i].ok) {
+                std::fprintf(stderr, "%s layouts: %s\n", label, results[i].error);
+                ok = false;
+                return;
+            }
+        }
+
+        const Result& measured = results[3];
+        if (synthetic) {
+            std::printf("%10s %16.3f %16.3f %16.3f %16.3f %14.1f %12.2f %14.1f %14.1f\n", label,
+                        results[0].startup_ms, results[1].startup_ms, results[2].startup_ms,
+                        results[3].startup_ms, measured.idle_frame_ns, measured.switch_us,
+                        measured.closed_menu_ns, measured.open_menu_ns);
+        } else {
+            std::printf("%10s %16.3f %16.3f %16.3f %16.3f\n", label, results[0].startup_ms,
+                        results[1].startup_ms, results[2].startup_ms, results[3].startup_ms);
+        }
+    };
+
+    if (!options.settings_file.empty()) {
+        std::ifstream in(options.settings_file, std::ios::binary);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        std::ofstream out(settings_path, std::ios::binary);
+        out << contents.str();
+        out.close();
+        if (!in || !out) {
+            std::fprintf(stderr, "couldn't copy %s\n", options.settings_file.c_str());
+            return 1;
+        }
+        run_settings("file", 0, false);
+    }
+
+    for (std::size_t layout_count = 10; layout_count <= options.max_layouts; layout_count *= 10) {
+        WriteSyntheticSettings(settings_path, layout_count);
+        run_settings(std::to_string(layout_count).c_str(), layout_count, true);
+    }
+
+    u64 short_presses_switched[2];
+    for (int i = 0; i < 2; ++i) {
+        WriteSyntheticSettings(settings_path, 10, i == 0 ? 0 : 1000);
+        const Result result =
+            RunInChild([&](Result& result) { RunShortPresses(options, result); });
+        if (!result.ok) {
+            std::fprintf(stderr, "short presses: %s\n", result.error);
+            ok = false;
+        }
+        short_presses_switched[i] = result.short_presses_switched;
+    }
+    std::printf("short presses switching layouts: %llu of %llu per frame, %llu of %llu with input "
+                "polling at 1000 Hz\n",
+                static_cast<unsigned long long>(short_presses_switched[0]),
+                static_cast<unsigned long long>(SHORT_PRESSES),
+                static_cast<unsigned long long>(short_presses_switched[1]),
+                static_cast<unsigned long long>(SHORT_PRESSES));
+    if (short_presses_switched[1] != SHORT_PRESSES) {
+        std::fprintf(stderr, "input polling lost short presses\n");
+        ok = false;
+    }
+
+    Result live_state_results[2];
+    for (int i = 0; i < 2; ++i) {
+        const bool publish = i == 1;
+        WriteSyntheticSettings(settings_path, LIVE_STATE_LAYOUTS, 0,
+                               publish ? LIVE_STATE_FILE : "");
+        live_state_results[i] =
+            RunInChild([&](Result& result) { RunLiveState(options, publish, result); });
+        if (!live_state_results[i].ok) {
+            std::fprintf(stderr, "live state: %s\n", live_state_results[i].error);
+            ok = false;
+        }
+    }
+    // The plugin looks it up the same way
+    const bool batched = dlsym(RTLD_DEFAULT, "vvctre_settings_set_custom_layout") != nullptr;
+    std::printf("host calls per switch: %.2f, %s vvctre_settings_set_custom_layout\n",
+                live_state_results[0].host_calls_per_switch, batched ? "with" : "without");
+    const Result& published = live_state_results[1];
+    std::printf("switch us with %zu layouts: %.2f, %.2f publishing the live state (%llu snapshots "
+                "read, %llu retries, %llu inconsistent)\n",
+                LIVE_STATE_LAYOUTS, live_state_results[0].switch_us, published.switch_us,
+                static_cast<unsigned long long>(published.snapshots),
+                static_cast<unsigned long long>(published.snapshot_retries),
+                static_cast<unsigned long long>(published.inconsistent_snapshots));
+    if (published.snapshots == 0 || published.inconsistent_snapshots != 0) {
+        std::fprintf(stderr, "the live state wasn't read consistently\n");
+        ok = false;
+    }
+
+    std::remove((GetVvctreFolder() + LIVE_STATE_FILE).c_str());
+    std::remove(settings_path.c_str());
+    std::remove(cache_path.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+/// Loads the plugin like vvctre does and gives access to its exported functions.
+class PluginLibrary {
+public:
+    typedef int (*GetRequiredFunctionCount_t)();
+    typedef const char** (*GetRequiredFunctionNames_t)();
+    typedef void (*PluginLoaded_t)(void* core, void* plugin_manager, void* required_functions[]);
+    typedef void (*Callback_t)();
+
+    PluginLibrary() = default;
+    PluginLibrary(const PluginLibrary&) = delete;
+    PluginLibrary& operator=(const PluginLibrary&) = delete;
+
+    ~PluginLibrary() {
+        if (handle != nullptr) {
+#ifdef _WIN32
+            FreeLibrary(static_cast<HMODULE>(handle));
+#else
+            dlclose(handle);
+#endif
+        }
+    }
+
+    bool Open(const std::string& path, std::string& error) {
+#ifdef _WIN32
+        handle = LoadLibraryA(path.c_str());
+        if (handle == nullptr) {
+            error = "failed to load " + path;
+            return false;
+        }
+#else
+        handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle == nullptr) {
+            error = dlerror();
+            return false;
+        }
+#endif
+
+        GetRequiredFunctionCount =
+            reinterpret_cast<GetRequiredFunctionCount_t>(GetSymbol("GetRequiredFunctionCount"));
+        GetRequiredFunctionNames =
+            reinterpret_cast<GetRequiredFunctionNames_t>(GetSymbol("GetRequiredFunctionNames"));
+        PluginLoaded = reinterpret_cast<PluginLoaded_t>(GetSymbol("PluginLoaded"));
+        InitialSettingsOpening = reinterpret_cast<Callback_t>(GetSymbol("InitialSettingsOpening"));
+        EmulationStarting = reinterpret_cast<Callback_t>(GetSymbol("EmulationStarting"));
+        EmulatorClosing = reinterpret_cast<Callback_t>(GetSymbol("EmulatorClosing"));
+        BeforeDrawingFPS = reinterpret_cast<Callback_t>(GetSymbol("BeforeDrawingFPS"));
+        AddMenu = reinterpret_cast<Callback_t>(GetSymbol("AddMenu"));
+
+        if (GetRequiredFunctionCount == nullptr || GetRequiredFunctionNames == nullptr ||
+            PluginLoaded == nullptr || InitialSettingsOpening == nullptr ||
+            EmulationStarting == nullptr || EmulatorClosing == nullptr ||
+            BeforeDrawingFPS == nullptr || AddMenu == nullptr) {
+            error = path + " doesn't export every plugin function";
+            return false;
+        }
+        return true;
+    }
+
+    void* GetSymbol(const char* name) const {
+#ifdef _WIN32
+        return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(handle), name));
+#else
+        return dlsym(handle, name);
+#endif
+    }
+
+    GetRequiredFunctionCount_t GetRequiredFunctionCount = nullptr;
+    GetRequiredFunctionNames_t GetRequiredFunctionNames = nullptr;
+    PluginLoaded_t PluginLoaded = nullptr;
+    Callback_t InitialSettingsOpening = nullptr;
+    Callback_t EmulationStarting = nullptr;
+    Callback_t EmulatorClosing = nullptr;
+    Callback_t BeforeDrawingFPS = nullptr;
+    Callback_t AddMenu = nullptr;
+
+private:
+    void* handle = nullptr;
+};
@@ -0,0 +1,208 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Scans a folder of synthetic profiles, switches between them the way the plugin does, rescans
+// while profiles are added and removed, and checks which profile is active and which ones stay
+// loaded under a memory limit. Then reloads the active profile the way the settings watcher does,
+// and selects profiles through a ProfileLoader.
+// Usage: profile-test FOLDER (an existing folder, its .json files and profiles.index are replaced)
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "file_util.h"
+#include "layout_cache.h"
+#include "profile_loader.h"
+#include "profiles.h"
+#include "settings.h"
+#include "synthetic_settings.h"
+
+static int failure_count = 0;
+
+static void Check(bool condition, const char* description) {
+    if (!condition) {
+        std::fprintf(stderr, "failed: %s\n", description);
+        ++failure_count;
+    }
+}
+
+static std::string ProfilePath(const std::string& folder, const std::string& name) {
+    return folder + name + ".json";
+}
+
+static void RemoveProfile(const std::string& folder, const std::string& name) {
+    const std::string path = ProfilePath(folder, name);
+    std::remove(path.c_str());
+    std::remove(GetLayoutCachePath(path).c_str());
+}
+
+// Selects a profile like the plugin, without its ProfileLoader thread
+static bool Use(ProfileManager& profiles, const char* name) {
+    ActiveProfile profile;
+    std::string error;
+    profiles.DescribeProfile(name, profile);
+    if (!ProfileManager::ReloadIfChanged(profile, error) ||
+        profiles.UseLoaded(profile) == ProfileManager::NO_PROFILE) {
+        std::fprintf(stderr, "failed to load %s: %s\n", name, error.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Waits for the loader's result like the frame hook, which checks every frame
+static bool WaitForLoaded(ProfileLoader& loader, ActiveProfile& profile, bool& loaded) {
+    std::string error;
+    for (int i = 0; i < 500; ++i) {
+        if (loader.TakeLoaded(profile, loaded, error)) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+static bool IsActive(const ProfileManager& profiles, const char* name) {
+    const std::size_t active = profiles.GetActive();
+    return active < profiles.GetCount() && profiles.GetProfile(active).name == name;
+}
+
+static bool IsLoaded(ProfileManager& profiles, const char* name) {
+    const std::size_t index = profiles.Find(name);
+    return index != ProfileManager::NO_PROFILE && profiles.GetProfile(index).programs != nullptr;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: profile-test FOLDER\n");
+        return 1;
+    }
+    std::string folder = argv[1];
+    if (folder.back() != '/') {
+        folder += '/';
+    }
+    for (const std::string& name : FileUtil::ListFiles(folder, ".json")) {
+        RemoveProfile(folder, name.substr(0, name.size() - 5));
+    }
+    std::remove((folder + "profiles.index").c_str());
+
+    WriteSyntheticSettings(ProfilePath(folder, "b"), 10);
+    ProfileManager profiles;
+    profiles.Open(folder);
+    profiles.Scan();
+    Check(profiles.GetCount() == 1, "the first scan finds the profile");
+    if (!Use(profiles, "b")) {
+        return 1;
+    }
+    Check(IsActive(profiles, "b"), "the loaded profile is active");
+
+    // Profiles sorting after, then before, the active one
+    WriteSyntheticSettings(ProfilePath(folder, "c"), 10);
+    profiles.Scan();
+    Check(profiles.GetCount() == 2 && IsActive(profiles, "b"),
+          "adding a profile after the active one keeps it active");
+    WriteSyntheticSettings(ProfilePath(folder, "a"), 10);
+    profiles.Scan();
+    Check(profiles.GetCount() == 3 && IsActive(profiles, "b"),
+          "adding a profile before the active one keeps it active");
+    RemoveProfile(folder, "a");
+    profiles.Scan();
+    Check(profiles.GetCount() == 2 && IsActive(profiles, "b"),
+          "removing another profile keeps the active one active");
+
+    // Its layouts are still in use
+    RemoveProfile(folder, "b");
+    profiles.Scan();
+    Check(profiles.GetCount() == 2 && IsActive(profiles, "b") && IsLoaded(profiles, "b"),
+          "removing the active profile's file keeps it until another profile is selected");
+    WriteSyntheticSettings(ProfilePath(folder, "b"), 10);
+
+    // The index written by the scans is read on the next start
+    ProfileManager reopened;
+    reopened.Open(folder);
+    Check(reopened.GetCount() == 2 && !reopened.IsScanned(),
+          "the index lists the profiles without scanning");
+
+    // Room for two profiles
+    const u64 profile_size = profiles.GetProfile(profiles.Find("b")).programs->GetMemoryUsage();
+    profiles.SetMemoryLimit(profile_size * 2);
+    WriteSyntheticSettings(ProfilePath(folder, "d"), 10);
+    profiles.Scan();
+    if (!Use(profiles, "c") || !Use(profiles, "d")) {
+        return 1;
+    }
+    Check(IsActive(profiles, "d") && IsLoaded(profiles, "d") && IsLoaded(profiles, "c") &&
+              !IsLoaded(profiles, "b"),
+          "loading a third profile unloads the least recently used one");
+    if (!Use(profiles, "b")) {
+        return 1;
+    }
+    Check(IsLoaded(profiles, "b") && IsLoaded(profiles, "d") && !IsLoaded(profiles, "c"),
+          "loading an unloaded profile unloads the least recently used one");
+
+    // A rescan moving the active profile must not let it be unloaded
+    WriteSyntheticSettings(ProfilePath(folder, "0"), 10);
+    profiles.Scan();
+    profiles.SetMemoryLimit(0);
+    Check(IsActive(profiles, "b") && IsLoaded(profiles, "b") && !IsLoaded(profiles, "d"),
+          "a memory limit after a rescan only keeps the active profile");
+
+    // What the settings watcher does on its thread, then the frame hook
+    ActiveProfile reloaded;
+    std::string error;
+    profiles.DescribeActive(reloaded);
+    Check(ProfileManager::ReloadIfChanged(reloaded, error) && !reloaded.reloaded,
+          "an unchanged active profile isn't reloaded");
+    const LayoutPrograms* programs = profiles.GetProfile(profiles.GetActive()).programs.get();
+    WriteSyntheticSettings(ProfilePath(folder, "b"), 20);
+    Check(ProfileManager::ReloadIfChanged(reloaded, error) && reloaded.reloaded,
+          "an edited active profile is reloaded");
+    profiles.UseReloaded(reloaded);
+    const ProfileManager::Profile& active = profiles.GetProfile(profiles.GetActive());
+    Check(active.programs.get() == programs && programs->size() == 20 && active.layout_count == 20,
+          "reloaded layouts replace the active profile's in place");
+
+    // Selected before the folder is listed again
+    WriteSyntheticSettings(ProfilePath(folder, "e"), 5);
+    ProfileLoader loader;
+    profiles.DescribeProfile("c", reloaded);
+    loader.Request(reloaded);
+    profiles.DescribeProfile("e", reloaded);
+    loader.Request(reloaded);
+    bool loaded = false;
+    Check(WaitForLoaded(loader, reloaded, loaded) && loaded && reloaded.name == "e",
+          "only the newest request is handed over");
+    const std::size_t added = profiles.UseLoaded(reloaded);
+    Check(added == profiles.Find("e") && IsActive(profiles, "e") &&
+              profiles.GetProfile(added).layout_count == 5,
+          "a loaded profile that wasn't listed yet is added and made active");
+    profiles.DescribeProfile("b", reloaded);
+    loader.Request(reloaded);
+    loader.Cancel();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    Check(!loader.TakeLoaded(reloaded, loaded, error), "a canceled request isn't handed over");
+    profiles.DescribeProfile("missing", reloaded);
+    loader.Request(reloaded);
+    Check(WaitForLoaded(loader, reloaded, loaded) && !loaded,
+          "a profile without a file isn't loaded");
+    loader.Stop();
+    profiles.WriteIndexIfOutdated();
+    ProfileManager indexed;
+    indexed.Open(folder);
+    Check(indexed.Find("e") != ProfileManager::NO_PROFILE &&
+              indexed.GetProfile(indexed.Find("e")).layout_count == 5,
+          "the layout counts found by selecting profiles are written to the index");
+
+    for (const char* name : {"0", "b", "c", "d", "e"}) {
+        RemoveProfile(folder, name);
+    }
+    std::remove((folder + "profiles.index").c_str());
+
+    if (failure_count != 0) {
+        return 1;
+    }
+    std::printf("profile scans, switches and evictions passed\n");
+    return 0;
+}
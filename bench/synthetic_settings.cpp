@@ -0,0 +1,40 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <fstream>
+
+#include "synthetic_settings.h"
+
+void WriteSyntheticSettings(const std::string& path, std::size_t layout_count,
+                            u32 polling_rate_hz, const std::string& live_state_path) {
+    static const char* const words[] = {"Alpha", "Bravo",  "Charlie", "Delta", "Echo",
+                                        "Foxtrot", "Golf", "Hotel",   "India", "Juliett"};
+    std::ofstream file(path, std::ios::trunc);
+    file << "{\n  \"button\": \"" << SYNTHETIC_BUTTON << "\",\n";
+    if (polling_rate_hz != 0) {
+        file << "  \"input_polling\": {\"enabled\": true, \"rate_hz\": " << polling_rate_hz
+             << "},\n";
+    }
+    if (!live_state_path.empty()) {
+        file << "  \"live_state\": {\"enabled\": true, \"path\": \"" << live_state_path
+             << "\"},\n";
+    }
+    file << "  \"layouts\": [\n";
+    for (std::size_t i = 0; i < layout_count; ++i) {
+        const int width = 400 + static_cast<int>(i % 1000);
+        const int height = 240 + static_cast<int>(i % 500);
+        file << "    {\n"
+             << "      \"name\": \"" << words[i % 10] << ' ' << i << "\",\n"
+             << "      \"upright\": " << (i % 2 == 0 ? "false" : "true") << ",\n"
+             << "      \"top_screen\": {\"left\": 0, \"top\": 0, \"right\": " << width
+             << ", \"bottom\": " << height << "},\n"
+             << "      \"bottom_screen\": {\"left\": 40, \"top\": " << height
+             << ", \"right\": 360, \"bottom\": " << height + 240 << "},\n"
+             << "      \"resize_window\": {\"enabled\": true, \"width\": " << width
+             << ", \"height\": " << height + 240 << "},\n"
+             << "      \"move_window\": {\"enabled\": false, \"x\": 0, \"y\": 0}\n"
+             << "    }" << (i + 1 == layout_count ? "\n" : ",\n");
+    }
+    file << "  ]\n}\n";
+}
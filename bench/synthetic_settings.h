@@ -0,0 +1,19 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "common_types.h"
+
+/// The button of synthetic settings files.
+constexpr const char* SYNTHETIC_BUTTON = "engine:keyboard,code:6";
+
+/// Writes a settings file with layout_count different named layouts, all resizing the window.
+/// A polling rate enables input polling, a live state path publishes the live state there.
+void WriteSyntheticSettings(const std::string& path, std::size_t layout_count,
+                            u32 polling_rate_hz = 0,
+                            const std::string& live_state_path = std::string());
@@ -0,0 +1,363 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Replays an input trace, recorded with the trace setting, through the plugin's exported functions
+// against the mock host. The host calls are compared with a golden file, and the cost of every
+// frame is reported. Frames are timed in a child process that doesn't record host calls.
+// The settings are replayed without their trace, watch_settings_file, control_socket,
+// instrumentation, input_polling, and live_state members, which would make the replay record,
+// reload, listen, poll, or publish on its own. Buttons released between frames were recorded as
+// pressed for a frame. Reloads replay as the Reload menu item in the frame before they were
+// recorded. Profiles aren't part of traces, and settings with a switching.settle_ms replay
+// depending on timing.
+// Usage: trace-replay TRACE [--plugin PATH] [--golden FILE] [--update-golden]
+//                     [--max-mean-frame-ns N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include "input_trace.h"
+#include "layout_cache.h"
+#include "mock_host.h"
+#include "plugin_library.h"
+#include "settings.h"
+
+struct Options {
+    std::string trace_path;
+    std::string plugin_path;
+    std::string golden_path;
+    bool update_golden = false;
+    double max_mean_frame_ns = 0;
+};
+
+struct Timing {
+    bool ok = false;
+    char error[256] = {};
+    u64 frame_count = 0;
+    double mean_ns = 0;
+    double p50_ns = 0;
+    double p99_ns = 0;
+    double max_ns = 0;
+};
+
+static double Elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// Writes recorded settings without the members that would make the replay do more than the plugin
+// did when recording
+static void WriteSettings(const std::string& path, const std::string& contents) {
+    nlohmann::json json = nlohmann::json::parse(contents, nullptr, false);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (json.is_object()) {
+        for (const char* key : {"trace", "watch_settings_file", "control_socket", "instrumentation",
+                                "input_polling", "live_state"}) {
+            json.erase(key);
+        }
+        file << json.dump(2);
+    } else {
+        // Invalid settings are replayed as they were, so the replay fails to load them too
+        file << contents;
+    }
+}
+
+static bool IsMenuFunction(MockHost::Function function) {
+    return function == MockHost::Function::GuiBeginMenu ||
+           function == MockHost::Function::GuiEndMenu ||
+           function == MockHost::Function::GuiMenuItem;
+}
+
+/**
+ * Replays the trace. The host calls other than menu calls go to lines, prefixed with the number of
+ * the frame they were made in, 0 being before the first frame.
+ */
+static bool Replay(const Options& options, bool record_calls, std::vector<std::string>& lines,
+                   std::vector<double>& frame_ns, std::string& error) {
+    InputTrace::Reader reader;
+    if (!reader.Open(options.trace_path, error)) {
+        return false;
+    }
+
+    PluginLibrary plugin;
+    if (!plugin.Open(options.plugin_path, error)) {
+        return false;
+    }
+
+    MockHost::Reset();
+    void* functions[64];
+    const int count = plugin.GetRequiredFunctionCount();
+    if (count > 64 || !MockHost::GetFunctions(plugin.GetRequiredFunctionNames(), count, functions)) {
+        error = "the plugin requires a function the mock host doesn't have";
+        return false;
+    }
+    MockHost::SetRecording(record_calls);
+
+    const std::string settings_path = GetSettingsFilePath();
+    std::remove(GetLayoutCachePath(settings_path).c_str());
+
+    u64 frame = 0;
+    const auto take_calls = [&] {
+        for (const MockHost::Call& call : MockHost::GetCalls()) {
+            if (!IsMenuFunction(call.function)) {
+                lines.push_back("frame " + std::to_string(frame) + ": " +
+                                MockHost::FormatCall(call));
+            }
+        }
+        MockHost::ClearCalls();
+    };
+
+    // The AddMenu of the last frame waits for the clicks and reloads recorded after the frame
+    bool add_menu_pending = false;
+    std::string click;
+    const auto run_pending_add_menu = [&] {
+        if (!add_menu_pending && click.empty()) {
+            return;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        if (click.empty()) {
+            plugin.AddMenu();
+        } else {
+            MockHost::SetMenusOpen(true);
+            MockHost::ClickMenuItem(click);
+            plugin.AddMenu();
+            MockHost::SetMenusOpen(false);
+            click.clear();
+        }
+        if (add_menu_pending) {
+            frame_ns.back() += Elapsed(start);
+        }
+        add_menu_pending = false;
+        take_calls();
+    };
+
+    std::vector<std::string> buttons;
+    bool initialized = false;
+    bool closed = false;
+    InputTrace::Entry entry;
+    while (!closed && reader.Next(entry, error)) {
+        if (!initialized && entry.event != InputTrace::Event::Settings &&
+            entry.event != InputTrace::Event::Bindings &&
+            entry.event != InputTrace::Event::InitialSettingsOpening) {
+            error = "the trace doesn't start with the settings";
+            break;
+        }
+        switch (entry.event) {
+        case InputTrace::Event::Settings:
+            WriteSettings(settings_path, entry.text);
+            if (initialized) {
+                click = "Reload (loads first layout)";
+            }
+            break;
+        case InputTrace::Event::Bindings:
+            buttons = std::move(entry.buttons);
+            break;
+        case InputTrace::Event::InitialSettingsOpening:
+            // PluginLoaded starts loading the settings, which the trace starts with
+            plugin.PluginLoaded(nullptr, nullptr, functions);
+            plugin.InitialSettingsOpening();
+            initialized = true;
+            take_calls();
+            break;
+        case InputTrace::Event::EmulationStarting:
+            run_pending_add_menu();
+            plugin.EmulationStarting();
+            take_calls();
+            break;
+        case InputTrace::Event::EmulatorClosing:
+            run_pending_add_menu();
+            plugin.EmulatorClosing();
+            closed = true;
+            take_calls();
+            break;
+        case InputTrace::Event::Frames:
+            run_pending_add_menu();
+            for (std::size_t i = 0; i < buttons.size(); ++i) {
+                MockHost::SetButtonState(buttons[i], (entry.button_state >> i & 1) != 0);
+            }
+            for (u64 i = 0; i < entry.frame_count; ++i) {
+                ++frame;
+                const auto start = std::chrono::steady_clock::now();
+                plugin.BeforeDrawingFPS();
+                if (i + 1 != entry.frame_count) {
+                    plugin.AddMenu();
+                }
+                frame_ns.push_back(Elapsed(start));
+                if (record_calls) {
+                    take_calls();
+                }
+            }
+            add_menu_pending = true;
+            break;
+        case InputTrace::Event::MenuClick:
+            click = entry.text;
+            break;
+        case InputTrace::Event::Count:
+            break;
+        }
+    }
+
+    if (initialized && !closed) {
+        // The recording stopped before vvctre closed
+        run_pending_add_menu();
+        plugin.EmulatorClosing();
+        take_calls();
+    }
+    std::remove(settings_path.c_str());
+    std::remove(GetLayoutCachePath(settings_path).c_str());
+    return error.empty();
+}
+
+static Timing TimeFrames(const Options& options) {
+    Timing timing;
+    std::vector<std::string> lines;
+    std::vector<double> frame_ns;
+    std::string error;
+    if (!Replay(options, false, lines, frame_ns, error)) {
+        std::snprintf(timing.error, sizeof(timing.error), "%s", error.c_str());
+        return timing;
+    }
+
+    timing.ok = true;
+    timing.frame_count = frame_ns.size();
+    if (frame_ns.empty()) {
+        return timing;
+    }
+    double total = 0;
+    for (const double ns : frame_ns) {
+        total += ns;
+    }
+    timing.mean_ns = total / frame_ns.size();
+    std::sort(frame_ns.begin(), frame_ns.end());
+    timing.p50_ns = frame_ns[frame_ns.size() / 2];
+    timing.p99_ns = frame_ns[frame_ns.size() * 99 / 100];
+    timing.max_ns = frame_ns.back();
+    return timing;
+}
+
+static Timing TimeFramesInChild(const Options& options) {
+    Timing timing;
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::snprintf(timing.error, sizeof(timing.error), "pipe failed");
+        return timing;
+    }
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        timing = TimeFrames(options);
+        const ssize_t written = write(fds[1], &timing, sizeof(timing));
+        _exit(written == sizeof(timing) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    if (pid < 0 || read(fds[0], &timing, sizeof(timing)) != sizeof(timing)) {
+        timing.ok = false;
+        std::snprintf(timing.error, sizeof(timing.error), "the replay process crashed");
+    }
+    close(fds[0]);
+    if (pid > 0) {
+        waitpid(pid, nullptr, 0);
+    }
+    return timing;
+}
+
+// Returns false and prints the first difference if lines don't match the golden file
+static bool CheckGolden(const std::string& path, const std::vector<std::string>& lines) {
+    std::ifstream file(path);
+    if (!file) {
+        std::fprintf(stderr, "failed to read %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    std::size_t i = 0;
+    for (; std::getline(file, line); ++i) {
+        if (i == lines.size() || line != lines[i]) {
+            std::fprintf(stderr, "%s:%zu: expected \"%s\", got \"%s\"\n", path.c_str(), i + 1,
+                         line.c_str(), i == lines.size() ? "end of the calls" : lines[i].c_str());
+            return false;
+        }
+    }
+    if (i != lines.size()) {
+        std::fprintf(stderr, "%s:%zu: expected the end of the calls, got \"%s\"\n", path.c_str(),
+                     i + 1, lines[i].c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    options.plugin_path = GetVvctreFolder() + "cycle-custom-layouts.so";
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--plugin") == 0 && i + 1 < argc) {
+            options.plugin_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            options.golden_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--update-golden") == 0) {
+            options.update_golden = true;
+        } else if (std::strcmp(argv[i], "--max-mean-frame-ns") == 0 && i + 1 < argc) {
+            options.max_mean_frame_ns = std::strtod(argv[++i], nullptr);
+        } else {
+            options.trace_path = argv[i];
+        }
+    }
+    if (options.trace_path.empty() || (options.update_golden && options.golden_path.empty())) {
+        std::fprintf(stderr, "Usage: %s TRACE [--plugin PATH] [--golden FILE] [--update-golden] "
+                             "[--max-mean-frame-ns N]\n",
+                     argv[0]);
+        return 1;
+    }
+
+    const Timing timing = TimeFramesInChild(options);
+    if (!timing.ok) {
+        std::fprintf(stderr, "%s\n", timing.error);
+        return 1;
+    }
+
+    std::vector<std::string> lines;
+    std::vector<double> frame_ns;
+    std::string error;
+    if (!Replay(options, true, lines, frame_ns, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    bool ok = true;
+    if (options.golden_path.empty()) {
+        for (const std::string& line : lines) {
+            std::printf("%s\n", line.c_str());
+        }
+    } else if (options.update_golden) {
+        std::ofstream file(options.golden_path, std::ios::trunc);
+        for (const std::string& line : lines) {
+            file << line << '\n';
+        }
+        std::printf("wrote %zu host calls to %s\n", lines.size(), options.golden_path.c_str());
+    } else if (CheckGolden(options.golden_path, lines)) {
+        std::printf("%zu host calls match %s\n", lines.size(), options.golden_path.c_str());
+    } else {
+        ok = false;
+    }
+
+    std::printf("%llu frames: mean %.1f ns, p50 %.1f ns, p99 %.1f ns, max %.1f ns\n",
+                static_cast<unsigned long long>(timing.frame_count), timing.mean_ns,
+                timing.p50_ns, timing.p99_ns, timing.max_ns);
+    if (options.max_mean_frame_ns != 0 && timing.mean_ns > options.max_mean_frame_ns) {
+        std::fprintf(stderr, "the mean frame took more than %.1f ns\n", options.max_mean_frame_ns);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,307 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "control_server.h"
+#ifdef _WIN32
+#include "string_util.h"
+#endif
+
+namespace {
+
+// Clients sending longer lines are disconnected
+constexpr std::size_t MAX_LINE_LENGTH = 1024;
+#ifndef _WIN32
+constexpr std::size_t MAX_CLIENTS = 8;
+#endif
+
+bool ParseIndex(const std::string& text, u64& index) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    index = std::strtoull(text.c_str(), nullptr, 10);
+    return true;
+}
+
+// Calls handle with every complete line in buffer and removes them from it.
+// Returns false if the client should be disconnected.
+template <typename Handle>
+bool TakeLines(std::string& buffer, Handle handle) {
+    std::string::size_type start = 0;
+    std::string::size_type end;
+    while ((end = buffer.find('\n', start)) != std::string::npos) {
+        std::string line = buffer.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!handle(line)) {
+            return false;
+        }
+        start = end + 1;
+    }
+    buffer.erase(0, start);
+    return buffer.size() <= MAX_LINE_LENGTH;
+}
+
+} // Anonymous namespace
+
+ControlServer::~ControlServer() {
+    Stop();
+}
+
+std::string ControlServer::HandleLine(const std::string& line) {
+    const std::string::size_type space = line.find(' ');
+    const std::string name = line.substr(0, space);
+    const std::string argument = space == std::string::npos ? "" : line.substr(space + 1);
+
+    if (name == "status") {
+        const u64 current_layout = status_current_layout.load(std::memory_order_relaxed);
+        const u64 layout_count = status_layout_count.load(std::memory_order_relaxed);
+        return "layout " +
+               (current_layout == static_cast<u64>(-1) ? std::string("none")
+                                                       : std::to_string(current_layout)) +
+               " of " + std::to_string(layout_count) + ", custom layout " +
+               (status_custom_layout_enabled.load(std::memory_order_relaxed) ? "on" : "off");
+    }
+
+    ControlCommand command{};
+    if (name == "next") {
+        command.type = ControlCommand::Type::Next;
+    } else if (name == "prev") {
+        command.type = ControlCommand::Type::Previous;
+    } else if (name == "reload") {
+        command.type = ControlCommand::Type::Reload;
+    } else if (name == "select" && ParseIndex(argument, command.index)) {
+        command.type = ControlCommand::Type::Select;
+    } else if (name == "select" || name == "profile") {
+        if (name == "select" && argument.empty()) {
+            return "error select needs a layout index or name";
+        }
+        if (argument.size() > ControlCommand::MAX_TEXT_LENGTH) {
+            return "error name too long";
+        }
+        command.type = name == "select" ? ControlCommand::Type::SelectName
+                                        : ControlCommand::Type::SelectProfile;
+        command.text_length = static_cast<u8>(argument.size());
+        std::memcpy(command.text, argument.data(), argument.size());
+    } else {
+        return "error unknown command " + name;
+    }
+
+    if (!commands.TryPush(command)) {
+        return "error too many queued commands";
+    }
+    return "ok";
+}
+
+#ifdef _WIN32
+
+bool ControlServer::Start(const std::string& path_) {
+    if (IsRunning()) {
+        return true;
+    }
+    path = path_;
+    stop_requested = false;
+    thread = std::thread(&ControlServer::Run, this);
+    return true;
+}
+
+void ControlServer::Stop() {
+    if (!IsRunning()) {
+        return;
+    }
+    stop_requested = true;
+    // Wakes ConnectNamedPipe, ReadFile or WriteFile. Repeated in case the thread wasn't blocked in
+    // them yet.
+    const HANDLE handle = static_cast<HANDLE>(thread.native_handle());
+    while (WaitForSingleObject(handle, 10) == WAIT_TIMEOUT) {
+        CancelSynchronousIo(handle);
+    }
+    thread.join();
+}
+
+void ControlServer::Run() {
+    const std::wstring pipe_name = Common::UTF8ToUTF16W("\\\\.\\pipe\\" + path);
+    std::string buffer;
+    char data[512];
+
+    while (!stop_requested) {
+        const HANDLE pipe =
+            CreateNamedPipeW(pipe_name.c_str(), PIPE_ACCESS_DUPLEX,
+                             PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+                                 PIPE_REJECT_REMOTE_CLIENTS,
+                             1, 4096, 4096, 0, nullptr);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            std::cerr << "cycle-custom-layouts: failed to create the control pipe " << path
+                      << std::endl;
+            return;
+        }
+
+        if (ConnectNamedPipe(pipe, nullptr) || GetLastError() == ERROR_PIPE_CONNECTED) {
+            buffer.clear();
+            DWORD read;
+            while (!stop_requested && ReadFile(pipe, data, sizeof(data), &read, nullptr) &&
+                   read != 0) {
+                buffer.append(data, read);
+                const bool keep = TakeLines(buffer, [&](const std::string& line) {
+                    const std::string answer = HandleLine(line) + '\n';
+                    DWORD written;
+                    return WriteFile(pipe, answer.data(), static_cast<DWORD>(answer.size()),
+                                     &written, nullptr) != FALSE;
+                });
+                if (!keep) {
+                    break;
+                }
+            }
+            DisconnectNamedPipe(pipe);
+        }
+        CloseHandle(pipe);
+    }
+}
+
+#else
+
+bool ControlServer::Start(const std::string& path_) {
+    if (IsRunning()) {
+        return true;
+    }
+    path = path_;
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "cycle-custom-layouts: the control socket path is too long: " << path
+                  << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        std::cerr << "cycle-custom-layouts: failed to create the control socket" << std::endl;
+        return false;
+    }
+    // A socket left behind by a vvctre that didn't exit cleanly would make bind fail
+    unlink(path.c_str());
+    if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(listen_fd, 4) != 0 ||
+        pipe(wake_pipe) != 0) {
+        std::cerr << "cycle-custom-layouts: failed to listen on " << path << std::endl;
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(path.c_str());
+        return false;
+    }
+    fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(wake_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wake_pipe[1], F_SETFD, FD_CLOEXEC);
+
+    thread = std::thread(&ControlServer::Run, this);
+    return true;
+}
+
+void ControlServer::Stop() {
+    if (!IsRunning()) {
+        return;
+    }
+
+    const char command = 's';
+    (void)write(wake_pipe[1], &command, 1);
+    thread.join();
+
+    close(listen_fd);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    listen_fd = wake_pipe[0] = wake_pipe[1] = -1;
+    unlink(path.c_str());
+}
+
+void ControlServer::Run() {
+    // fds[0] is the wake pipe, fds[1] the listening socket, the others are clients
+    std::vector<pollfd> fds = {{wake_pipe[0], POLLIN, 0}, {listen_fd, POLLIN, 0}};
+    std::vector<std::string> buffers(2);
+    char data[512];
+
+    const auto disconnect = [&](std::size_t i) {
+        close(fds[i].fd);
+        fds.erase(fds.begin() + i);
+        buffers.erase(buffers.begin() + i);
+    };
+
+    while (true) {
+        if (poll(fds.data(), fds.size(), -1) <= 0) {
+            continue;
+        }
+        if (fds[0].revents != 0) {
+            break;
+        }
+
+        for (std::size_t i = fds.size() - 1; i >= 2; --i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            const ssize_t count = read(fds[i].fd, data, sizeof(data));
+            if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                continue;
+            }
+            if (count <= 0) {
+                disconnect(i);
+                continue;
+            }
+            buffers[i].append(data, static_cast<std::size_t>(count));
+            const int fd = fds[i].fd;
+            // The socket doesn't block, a client that doesn't read its answers is disconnected
+            // when they fill its buffer rather than stalling the thread and Stop
+            const bool keep = TakeLines(buffers[i], [&](const std::string& line) {
+                const std::string answer = HandleLine(line) + '\n';
+#ifdef MSG_NOSIGNAL
+                const int flags = MSG_NOSIGNAL;
+#else
+                const int flags = 0;
+#endif
+                return send(fd, answer.data(), answer.size(), flags) ==
+                       static_cast<ssize_t>(answer.size());
+            });
+            if (!keep) {
+                disconnect(i);
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            const int client = accept(listen_fd, nullptr, nullptr);
+            if (client != -1) {
+                if (fds.size() - 2 < MAX_CLIENTS) {
+                    fcntl(client, F_SETFD, FD_CLOEXEC);
+                    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                    fds.push_back({client, POLLIN, 0});
+                    buffers.emplace_back();
+                } else {
+                    close(client);
+                }
+            }
+        }
+    }
+
+    for (std::size_t i = 2; i < fds.size(); ++i) {
+        close(fds[i].fd);
+    }
+}
+
+#endif
@@ -0,0 +1,92 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "common_types.h"
+#include "spsc_ring.h"
+
+struct ControlCommand {
+    enum class Type : u8 {
+        Next,
+        Previous,
+        /// Selects the layout at index
+        Select,
+        /// Selects the first layout named text
+        SelectName,
+        /// Selects the profile named text, or the settings file's layouts if text is empty
+        SelectProfile,
+        Reload,
+    };
+
+    static constexpr std::size_t MAX_TEXT_LENGTH = 110;
+
+    Type type;
+    u8 text_length;
+    u64 index;
+    char text[MAX_TEXT_LENGTH];
+};
+
+/**
+ * Lets scripts control the plugin through a Unix domain socket, or a named pipe on Windows.
+ * Clients send one command per line and get one line back:
+ *   next, prev, select <index or layout name>, profile [name], reload: "ok" once queued
+ *   status: "layout <index> of <count>, custom layout <on or off>"
+ *   anything else: "error <message>"
+ * Clients that don't read their answers are disconnected once their socket's buffer is full.
+ * A background thread serves the clients and queues commands in a ring the frame hook drains,
+ * so the frame hook never waits for a client, takes a lock or makes a system call.
+ */
+class ControlServer {
+public:
+    ~ControlServer();
+
+    /// path is the socket's path, or the pipe's name on Windows. Returns false if it can't listen.
+    bool Start(const std::string& path);
+    void Stop();
+
+    /// Only for the thread that calls Start and Stop.
+    bool IsRunning() const {
+        return thread.joinable();
+    }
+    const std::string& GetPath() const {
+        return path;
+    }
+
+    /// Returns the next queued command. One atomic load when there's none.
+    bool TryPop(ControlCommand& command) {
+        return commands.TryPop(command);
+    }
+
+    /// Sets what the status command answers.
+    void PublishStatus(u64 current_layout, u64 layout_count, bool custom_layout_enabled) {
+        status_current_layout.store(current_layout, std::memory_order_relaxed);
+        status_layout_count.store(layout_count, std::memory_order_relaxed);
+        status_custom_layout_enabled.store(custom_layout_enabled, std::memory_order_relaxed);
+    }
+
+private:
+    void Run();
+    /// Returns the answer to a command line, without the line break
+    std::string HandleLine(const std::string& line);
+
+    std::string path;
+    std::thread thread;
+    SPSCRing<ControlCommand, 64> commands;
+
+    std::atomic<u64> status_current_layout{static_cast<u64>(-1)};
+    std::atomic<u64> status_layout_count{0};
+    std::atomic<bool> status_custom_layout_enabled{false};
+
+#ifdef _WIN32
+    std::atomic<bool> stop_requested{false};
+#else
+    int listen_fd = -1;
+    int wake_pipe[2] = {-1, -1};
+#endif
+};
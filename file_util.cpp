@@ -0,0 +1,245 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <atomic>
+#include <fstream>
+#include <utility>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "file_util.h"
+#include "string_util.h"
+
+namespace FileUtil {
+
+bool GetFileStamp(const std::string& path, FileStamp& stamp) {
+#ifdef _WIN32
+    struct _stat64 file_info;
+    if (_wstat64(Common::UTF8ToUTF16W(path).c_str(), &file_info) != 0) {
+        return false;
+    }
+#else
+    struct stat file_info;
+    if (stat(path.c_str(), &file_info) != 0) {
+        return false;
+    }
+#endif
+
+    stamp.size = static_cast<u64>(file_info.st_size);
+#ifdef __linux__
+    stamp.modification_time = static_cast<s64>(file_info.st_mtim.tv_sec) * 1000000000 +
+                              static_cast<s64>(file_info.st_mtim.tv_nsec);
+#elif defined(__APPLE__)
+    stamp.modification_time = static_cast<s64>(file_info.st_mtimespec.tv_sec) * 1000000000 +
+                              static_cast<s64>(file_info.st_mtimespec.tv_nsec);
+#else
+    stamp.modification_time = static_cast<s64>(file_info.st_mtime);
+#endif
+    return true;
+}
+
+static bool EndsWith(const std::string& name, const std::string& extension) {
+    return name.size() > extension.size() &&
+           name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+std::vector<std::string> ListFiles(const std::string& directory, const std::string& extension) {
+    std::vector<std::string> names;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAW find_data;
+    const HANDLE find =
+        FindFirstFileW(Common::UTF8ToUTF16W(directory + '*').c_str(), &find_data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return names;
+    }
+    do {
+        if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+            std::string name = Common::UTF16ToUTF8(find_data.cFileName);
+            if (EndsWith(name, extension)) {
+                names.push_back(std::move(name));
+            }
+        }
+    } while (FindNextFileW(find, &find_data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        return names;
+    }
+    while (const dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        struct stat file_info;
+        if (EndsWith(name, extension) &&
+            stat((directory + name).c_str(), &file_info) == 0 &&
+            S_ISREG(file_info.st_mode)) {
+            names.push_back(std::move(name));
+        }
+    }
+    closedir(dir);
+#endif
+
+    return names;
+}
+
+std::FILE* OpenFile(const std::string& path, const char* mode) {
+#ifdef _WIN32
+    return _wfopen(Common::UTF8ToUTF16W(path).c_str(), Common::UTF8ToUTF16W(mode).c_str());
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+
+bool ReadFile(const std::string& path, std::vector<u8>& data) {
+    std::FILE* file = OpenFile(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    u8 chunk[16 * 1024];
+    std::size_t read;
+    while ((read = std::fread(chunk, 1, sizeof(chunk), file)) != 0) {
+        data.insert(data.end(), chunk, chunk + read);
+    }
+    const bool ok = std::ferror(file) == 0;
+    std::fclose(file);
+    return ok;
+}
+
+// Unique to every call, so concurrent writers of a file, in this process or another vvctre,
+// never write to the same temporary file
+static std::string GetTemporaryPath(const std::string& path) {
+    static std::atomic<u32> next_number{0};
+#ifdef _WIN32
+    const unsigned long process = GetCurrentProcessId();
+#else
+    const unsigned long process = static_cast<unsigned long>(getpid());
+#endif
+    return path + '.' + std::to_string(process) + '.' +
+           std::to_string(next_number.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+}
+
+bool WriteFileAtomically(const std::string& path, const void* data, std::size_t size) {
+    const std::string temporary_path = GetTemporaryPath(path);
+
+    {
+        std::ofstream file;
+#ifdef _MSC_VER
+        file.open(Common::UTF8ToUTF16W(temporary_path), std::ios::binary | std::ios::trunc);
+#else
+        file.open(temporary_path, std::ios::binary | std::ios::trunc);
+#endif
+        if (file.fail()) {
+            return false;
+        }
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (file.fail()) {
+            file.close();
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    if (!MoveFileExW(Common::UTF8ToUTF16W(temporary_path).c_str(),
+                     Common::UTF8ToUTF16W(path).c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(Common::UTF8ToUTF16W(temporary_path).c_str());
+        return false;
+    }
+#else
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+#endif
+    return true;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        Close();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+
+#ifdef _WIN32
+    const HANDLE file =
+        CreateFileW(Common::UTF8ToUTF16W(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == nullptr) {
+        return false;
+    }
+    data = static_cast<const u8*>(view);
+    size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat file_info;
+    if (fstat(fd, &file_info) != 0 || file_info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* view =
+        mmap(nullptr, static_cast<std::size_t>(file_info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    data = static_cast<const u8*>(view);
+    size = static_cast<std::size_t>(file_info.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<u8*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+} // namespace FileUtil
@@ -0,0 +1,80 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common_types.h"
+
+namespace FileUtil {
+
+struct FileStamp {
+    u64 size = 0;
+    s64 modification_time = 0;
+
+    bool operator==(const FileStamp& other) const {
+        return size == other.size && modification_time == other.modification_time;
+    }
+    bool operator!=(const FileStamp& other) const {
+        return !(*this == other);
+    }
+};
+
+/// Gets the size and modification time of a file. Returns false if the file doesn't exist.
+bool GetFileStamp(const std::string& path, FileStamp& stamp);
+
+/// Whether GetFileStamp's modification times are in nanoseconds. Elsewhere they're in seconds, and
+/// two edits within a second that keep the size give equal stamps.
+#if defined(__linux__) || defined(__APPLE__)
+constexpr bool PRECISE_FILE_STAMPS = true;
+#else
+constexpr bool PRECISE_FILE_STAMPS = false;
+#endif
+
+/// Returns the names of the regular files in directory, which ends with a separator, that end
+/// with extension.
+std::vector<std::string> ListFiles(const std::string& directory, const std::string& extension);
+
+/// Opens a file with std::fopen, or _wfopen on Windows so UTF-8 paths work.
+std::FILE* OpenFile(const std::string& path, const char* mode);
+
+/// Appends the contents of a file to data.
+bool ReadFile(const std::string& path, std::vector<u8>& data);
+
+/**
+ * Writes a file by writing a temporary file and renaming it, so readers never see a partial file.
+ * Concurrent writers use their own temporary files, the last rename wins.
+ */
+bool WriteFileAtomically(const std::string& path, const void* data, std::size_t size);
+
+/// A read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const u8* Data() const {
+        return data;
+    }
+    std::size_t Size() const {
+        return size;
+    }
+
+private:
+    const u8* data = nullptr;
+    std::size_t size = 0;
+};
+
+} // namespace FileUtil
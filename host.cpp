@@ -0,0 +1,87 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "host.h"
+
+#define DEFINE_HOST_FUNCTION(name, return_type, parameters)                                        \
+    namespace HostFunctions {                                                                     \
+    name##_t name = nullptr;                                                                      \
+    }
+VVCTRE_REQUIRED_FUNCTIONS(DEFINE_HOST_FUNCTION)
+VVCTRE_OPTIONAL_FUNCTIONS(DEFINE_HOST_FUNCTION)
+#undef DEFINE_HOST_FUNCTION
+
+#define HOST_FUNCTION_NAME(name, return_type, parameters) #name,
+const char* required_function_names[REQUIRED_FUNCTION_COUNT] = {
+    VVCTRE_REQUIRED_FUNCTIONS(HOST_FUNCTION_NAME)};
+static constexpr std::string_view host_function_names[] = {
+    VVCTRE_REQUIRED_FUNCTIONS(HOST_FUNCTION_NAME) VVCTRE_OPTIONAL_FUNCTIONS(HOST_FUNCTION_NAME)};
+#undef HOST_FUNCTION_NAME
+
+#define COUNT_HOST_FUNCTION(name, return_type, parameters) +1
+static constexpr std::size_t OPTIONAL_FUNCTION_COUNT =
+    0 VVCTRE_OPTIONAL_FUNCTIONS(COUNT_HOST_FUNCTION);
+#undef COUNT_HOST_FUNCTION
+
+// Whether every name is a vvctre function, and none is listed twice
+template <std::size_t Count>
+static constexpr bool AreValidNames(const std::string_view (&names)[Count]) {
+    for (std::size_t i = 0; i < Count; ++i) {
+        if (names[i].substr(0, 7) != "vvctre_") {
+            return false;
+        }
+        for (std::size_t j = 0; j < i; ++j) {
+            if (names[i] == names[j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(sizeof(host_function_names) / sizeof(host_function_names[0]) ==
+              REQUIRED_FUNCTION_COUNT + OPTIONAL_FUNCTION_COUNT);
+static_assert(AreValidNames(host_function_names));
+// vvctre doesn't load plugins requiring a function it doesn't have, new functions should be optional
+static_assert(REQUIRED_FUNCTION_COUNT == 19);
+
+template <typename Function>
+static Function Cast(void* function) {
+    static_assert(std::is_pointer_v<Function> &&
+                  std::is_function_v<std::remove_pointer_t<Function>>);
+    return reinterpret_cast<Function>(function);
+}
+
+static void* FindOptionalFunction(const char* name) {
+#ifdef _WIN32
+    return reinterpret_cast<void*>(GetProcAddress(GetModuleHandleW(nullptr), name));
+#else
+    return dlsym(RTLD_DEFAULT, name);
+#endif
+}
+
+void* plugin_manager = nullptr;
+
+void LoadHostFunctions(void* required_functions[]) {
+#define LOAD_REQUIRED_FUNCTION(name, return_type, parameters)                                      \
+    HostFunctions::name =                                                                         \
+        Cast<name##_t>(required_functions[static_cast<int>(RequiredFunction::name)]);
+    VVCTRE_REQUIRED_FUNCTIONS(LOAD_REQUIRED_FUNCTION)
+#undef LOAD_REQUIRED_FUNCTION
+
+#define LOAD_OPTIONAL_FUNCTION(name, return_type, parameters)                                      \
+    HostFunctions::name = Cast<name##_t>(FindOptionalFunction(#name));
+    VVCTRE_OPTIONAL_FUNCTIONS(LOAD_OPTIONAL_FUNCTION)
+#undef LOAD_OPTIONAL_FUNCTION
+}
@@ -0,0 +1,72 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common_types.h"
+
+/**
+ * The vvctre functions the plugin calls, as X(name, return type, parameters).
+ * Everything else in this file is generated from these lists: the typedef name##_t, the pointer
+ * name, and for required functions, their index in required_function_names.
+ * Required functions are passed to PluginLoaded in list order. Optional functions are looked up
+ * in vvctre's executable when the plugin is loaded, and are nullptr if vvctre doesn't export them.
+ */
+#define VVCTRE_REQUIRED_FUNCTIONS(X)                                                               \
+    X(vvctre_settings_set_custom_layout_top_left, void, (u16 value))                              \
+    X(vvctre_settings_set_custom_layout_top_top, void, (u16 value))                               \
+    X(vvctre_settings_set_custom_layout_top_right, void, (u16 value))                             \
+    X(vvctre_settings_set_custom_layout_top_bottom, void, (u16 value))                            \
+    X(vvctre_settings_set_custom_layout_bottom_left, void, (u16 value))                           \
+    X(vvctre_settings_set_custom_layout_bottom_top, void, (u16 value))                            \
+    X(vvctre_settings_set_custom_layout_bottom_right, void, (u16 value))                          \
+    X(vvctre_settings_set_custom_layout_bottom_bottom, void, (u16 value))                         \
+    X(vvctre_button_device_new, void*, (void* plugin_manager, const char* params))                \
+    X(vvctre_button_device_get_state, bool, (void* device))                                       \
+    X(vvctre_settings_apply, void, ())                                                            \
+    X(vvctre_settings_set_use_custom_layout, void, (bool value))                                  \
+    X(vvctre_set_os_window_size, void, (void* plugin_manager, int width, int height))             \
+    X(vvctre_set_os_window_position, void, (void* plugin_manager, int x, int y))                  \
+    X(vvctre_settings_set_upright_screens, void, (bool value))                                    \
+    X(vvctre_gui_begin_menu, bool, (const char* label))                                           \
+    X(vvctre_gui_end_menu, void, ())                                                              \
+    X(vvctre_gui_menu_item, bool, (const char* label))                                            \
+    X(vvctre_button_device_delete, void, (void* plugin_manager, void* device))
+
+/// vvctre_settings_set_custom_layout sets both screen rectangles, in place of 8 calls
+#define VVCTRE_OPTIONAL_FUNCTIONS(X)                                                               \
+    X(vvctre_settings_set_custom_layout, void,                                                    \
+      (u16 top_left, u16 top_top, u16 top_right, u16 top_bottom, u16 bottom_left, u16 bottom_top, \
+       u16 bottom_right, u16 bottom_bottom))
+
+// The pointers are in a namespace so their symbols can't be mistaken for vvctre's functions
+#define DECLARE_HOST_FUNCTION(name, return_type, parameters)                                       \
+    typedef return_type(*name##_t) parameters;                                                    \
+    namespace HostFunctions {                                                                     \
+    extern name##_t name;                                                                         \
+    }                                                                                             \
+    using HostFunctions::name;
+VVCTRE_REQUIRED_FUNCTIONS(DECLARE_HOST_FUNCTION)
+VVCTRE_OPTIONAL_FUNCTIONS(DECLARE_HOST_FUNCTION)
+#undef DECLARE_HOST_FUNCTION
+
+/// Indexes in required_function_names
+enum class RequiredFunction {
+#define DECLARE_REQUIRED_FUNCTION(name, return_type, parameters) name,
+    VVCTRE_REQUIRED_FUNCTIONS(DECLARE_REQUIRED_FUNCTION)
+#undef DECLARE_REQUIRED_FUNCTION
+    Count,
+};
+
+constexpr int REQUIRED_FUNCTION_COUNT = static_cast<int>(RequiredFunction::Count);
+
+extern const char* required_function_names[REQUIRED_FUNCTION_COUNT];
+
+extern void* plugin_manager;
+
+/**
+ * Stores the functions vvctre passes to PluginLoaded, in the order of required_function_names,
+ * and looks up the optional functions.
+ */
+void LoadHostFunctions(void* required_functions[]);
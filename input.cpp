@@ -0,0 +1,145 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "host.h"
+#include "input.h"
+#include "instrumentation.h"
+
+InputEngine::~InputEngine() {
+    StopPolling();
+    // The devices belong to vvctre, which may be gone when static objects are destroyed
+    devices.clear();
+}
+
+void InputEngine::SetBindings(const std::vector<ButtonBinding>& new_bindings) {
+    if (new_bindings == bindings && !devices.empty()) {
+        return;
+    }
+
+    Clear();
+
+    if (new_bindings.size() > MAX_BINDINGS) {
+        std::cerr << "cycle-custom-layouts: only the first " << MAX_BINDINGS
+                  << " button bindings are used" << std::endl;
+    }
+
+    for (std::size_t i = 0; i < new_bindings.size() && i < MAX_BINDINGS; ++i) {
+        bindings.push_back(new_bindings[i]);
+        devices.push_back(vvctre_button_device_new(plugin_manager, new_bindings[i].button.c_str()));
+    }
+    StartPolling();
+}
+
+void InputEngine::Clear() {
+    StopPolling();
+    for (void* device : devices) {
+        vvctre_button_device_delete(plugin_manager, device);
+    }
+    devices.clear();
+    bindings.clear();
+    previous_state = 0;
+}
+
+void InputEngine::SetPollingRate(u32 rate_hz) {
+    if (rate_hz != polling_rate_hz) {
+        StopPolling();
+        polling_rate_hz = rate_hz;
+        StartPolling();
+    }
+}
+
+u64 InputEngine::Poll() {
+    if (polling_thread.joinable()) {
+        previous_state = polled_state.load(std::memory_order_relaxed) |
+                         released_since_poll.exchange(0, std::memory_order_relaxed);
+        return 0;
+    }
+
+    u64 state = 0;
+    for (std::size_t i = 0; i < devices.size(); ++i) {
+        state |= static_cast<u64>(vvctre_button_device_get_state(devices[i])) << i;
+    }
+    const u64 released = previous_state & ~state;
+    previous_state = state;
+    return released;
+}
+
+// The thread only runs while there are devices to sample, so having no bindings costs nothing
+void InputEngine::StartPolling() {
+    if (polling_rate_hz == 0 || devices.empty() || polling_thread.joinable()) {
+        return;
+    }
+    stop_polling = false;
+    polled_state.store(previous_state, std::memory_order_relaxed);
+    polling_thread = std::thread(&InputEngine::PollingThread, this);
+}
+
+void InputEngine::StopPolling() {
+    if (!polling_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(polling_mutex);
+        stop_polling = true;
+    }
+    polling_condition_variable.notify_one();
+    polling_thread.join();
+
+    // Releases of the old devices mean nothing for the next ones
+    Release release;
+    while (releases.TryPop(release)) {
+    }
+    previous_state = polled_state.load(std::memory_order_relaxed);
+    released_since_poll.store(0, std::memory_order_relaxed);
+}
+
+// vvctre's button devices store their state in atomics, so they can be sampled from any thread
+void InputEngine::PollingThread() {
+    const std::chrono::steady_clock::duration interval =
+        std::chrono::nanoseconds(1000000000 / polling_rate_hz);
+    auto next_sample = std::chrono::steady_clock::now();
+    u64 state = polled_state.load(std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock(polling_mutex);
+    while (!stop_polling) {
+        u64 sampled = 0;
+        for (std::size_t i = 0; i < devices.size(); ++i) {
+            sampled |= static_cast<u64>(vvctre_button_device_get_state(devices[i])) << i;
+        }
+
+        const u64 released = state & ~sampled;
+        if (released != 0) {
+            const u64 timestamp = Instrumentation::Now();
+            for (u64 remaining = released; remaining != 0; remaining &= remaining - 1) {
+                // A full ring means the frames stopped, the press is dropped
+                releases.TryPush(Release{static_cast<u32>(GetLowestSetBit(remaining)), timestamp});
+            }
+            released_since_poll.fetch_or(released, std::memory_order_relaxed);
+        }
+        state = sampled;
+        polled_state.store(sampled, std::memory_order_relaxed);
+
+        // Samples late rather than in bursts if the thread fell behind
+        next_sample = std::max(next_sample + interval, std::chrono::steady_clock::now());
+        polling_condition_variable.wait_until(lock, next_sample, [this] { return stop_polling; });
+    }
+}
+
+int GetLowestSetBit(u64 mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
@@ -0,0 +1,86 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common_types.h"
+#include "settings.h"
+#include "spsc_ring.h"
+
+/**
+ * Owns the button devices of every binding and samples each of them exactly once per frame into
+ * a bitmask, bit i being binding i. Edges are found with bitwise operations on the bitmask, so the
+ * cost per frame is one host call per binding no matter what the bindings do.
+ * With a polling rate, a thread samples the devices instead and queues every release, so presses
+ * shorter than a frame aren't lost.
+ */
+class InputEngine {
+public:
+    static constexpr std::size_t MAX_BINDINGS = 64;
+
+    /// A release seen by the polling thread
+    struct Release {
+        u32 binding;
+        /// Instrumentation::Now() when the release was seen
+        u64 timestamp;
+    };
+
+    ~InputEngine();
+
+    /// Deletes the current devices and creates new ones, unless the bindings didn't change.
+    void SetBindings(const std::vector<ButtonBinding>& bindings);
+    void Clear();
+
+    /// 0 samples the devices in Poll, otherwise a thread samples them rate_hz times per second.
+    void SetPollingRate(u32 rate_hz);
+
+    /**
+     * Samples every device and returns the bindings whose button was released since the last call.
+     * Returns 0 when the polling thread samples the devices, see TakeRelease.
+     */
+    u64 Poll();
+
+    /// Takes the oldest release queued by the polling thread. Returns false if there's none.
+    bool TakeRelease(Release& release) {
+        return releases.TryPop(release);
+    }
+
+    /// The state sampled by the last Poll, bit i being binding i. With the polling thread, buttons
+    /// released since the previous Poll count as pressed.
+    u64 GetState() const {
+        return previous_state;
+    }
+
+    const ButtonBinding& GetBinding(std::size_t index) const {
+        return bindings[index];
+    }
+
+private:
+    void StartPolling();
+    void StopPolling();
+    void PollingThread();
+
+    std::vector<ButtonBinding> bindings;
+    std::vector<void*> devices;
+    u64 previous_state = 0;
+
+    u32 polling_rate_hz = 0;
+    std::thread polling_thread;
+    std::mutex polling_mutex;
+    std::condition_variable polling_condition_variable;
+    bool stop_polling = false;
+    SPSCRing<Release, 256> releases;
+    /// Written by the polling thread
+    std::atomic<u64> polled_state{0};
+    std::atomic<u64> released_since_poll{0};
+};
+
+/// Returns the index of the lowest set bit, mask must not be 0.
+int GetLowestSetBit(u64 mask);
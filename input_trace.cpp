@@ -0,0 +1,217 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <iostream>
+
+#include "file_util.h"
+#include "input_trace.h"
+#include "settings.h"
+
+namespace InputTrace {
+
+constexpr std::size_t FLUSH_SIZE = 64 * 1024;
+
+Recorder::~Recorder() {
+    Stop();
+}
+
+bool Recorder::Start(const std::string& output_path, const std::vector<u8>& settings_contents,
+                     const std::vector<ButtonBinding>& bindings) {
+    Stop();
+
+    file = FileUtil::OpenFile(output_path, "wb");
+    if (file == nullptr) {
+        std::cerr << "cycle-custom-layouts: failed to create " << output_path << std::endl;
+        return false;
+    }
+
+    const TraceHeader header{TRACE_MAGIC, TRACE_VERSION};
+    buffer.resize(sizeof(header));
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    WriteSettings(settings_contents, bindings);
+    WriteEvent(Event::InitialSettingsOpening);
+    return true;
+}
+
+void Recorder::Stop() {
+    if (file == nullptr) {
+        return;
+    }
+    FlushFrames();
+    FlushBuffer();
+    std::fclose(file);
+    file = nullptr;
+}
+
+void Recorder::OnReload(const std::vector<u8>& settings_contents,
+                        const std::vector<ButtonBinding>& bindings) {
+    if (file != nullptr) {
+        FlushFrames();
+        WriteSettings(settings_contents, bindings);
+    }
+}
+
+void Recorder::OnHook(Event event) {
+    if (file == nullptr) {
+        return;
+    }
+    FlushFrames();
+    WriteEvent(event);
+    FlushBuffer();
+    if (event == Event::EmulatorClosing) {
+        Stop();
+    }
+}
+
+void Recorder::OnMenuClick(const char* label) {
+    if (file != nullptr) {
+        FlushFrames();
+        WriteEvent(Event::MenuClick);
+        WriteString(label, std::strlen(label));
+    }
+}
+
+void Recorder::FlushFrames() {
+    if (frame_count == 0) {
+        return;
+    }
+    WriteEvent(Event::Frames);
+    WriteNumber(frame_count);
+    WriteNumber(frame_button_state);
+    frame_count = 0;
+    if (buffer.size() >= FLUSH_SIZE) {
+        FlushBuffer();
+    }
+}
+
+void Recorder::WriteEvent(Event event) {
+    buffer.push_back(static_cast<u8>(event));
+}
+
+void Recorder::WriteNumber(u64 value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<u8>(value) | 0x80);
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<u8>(value));
+}
+
+void Recorder::WriteString(const char* data, std::size_t size) {
+    WriteNumber(size);
+    buffer.insert(buffer.end(), data, data + size);
+}
+
+void Recorder::WriteSettings(const std::vector<u8>& settings_contents,
+                             const std::vector<ButtonBinding>& bindings) {
+    WriteEvent(Event::Settings);
+    WriteString(reinterpret_cast<const char*>(settings_contents.data()), settings_contents.size());
+
+    WriteEvent(Event::Bindings);
+    WriteNumber(bindings.size());
+    for (const ButtonBinding& binding : bindings) {
+        WriteString(binding.button.data(), binding.button.size());
+    }
+}
+
+void Recorder::FlushBuffer() {
+    if (!buffer.empty() && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        std::cerr << "cycle-custom-layouts: failed to write the input trace" << std::endl;
+    }
+    std::fflush(file);
+    buffer.clear();
+}
+
+bool Reader::Open(const std::string& path, std::string& error) {
+    data.clear();
+    position = sizeof(TraceHeader);
+
+    TraceHeader header;
+    if (!FileUtil::ReadFile(path, data)) {
+        error = "failed to read " + path;
+        return false;
+    }
+    if (data.size() < sizeof(header)) {
+        error = path + " is too small to be a trace";
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != TRACE_MAGIC) {
+        error = path + " isn't a trace";
+        return false;
+    }
+    if (header.version != TRACE_VERSION) {
+        error = path + " has version " + std::to_string(header.version) + ", expected " +
+                std::to_string(TRACE_VERSION);
+        return false;
+    }
+    return true;
+}
+
+bool Reader::Next(Entry& entry, std::string& error) {
+    if (position == data.size()) {
+        return false;
+    }
+
+    entry.event = static_cast<Event>(data[position++]);
+    bool ok = true;
+    switch (entry.event) {
+    case Event::Settings:
+    case Event::MenuClick:
+        ok = ReadString(entry.text);
+        break;
+    case Event::Bindings: {
+        u64 count;
+        ok = ReadNumber(count) && count <= data.size() - position;
+        entry.buttons.resize(ok ? count : 0);
+        for (std::string& button : entry.buttons) {
+            ok = ok && ReadString(button);
+        }
+        break;
+    }
+    case Event::Frames:
+        ok = ReadNumber(entry.frame_count) && ReadNumber(entry.button_state);
+        break;
+    case Event::InitialSettingsOpening:
+    case Event::EmulationStarting:
+    case Event::EmulatorClosing:
+        break;
+    default:
+        error = "unknown event " + std::to_string(static_cast<int>(entry.event)) + " at offset " +
+                std::to_string(position - 1);
+        return false;
+    }
+
+    if (!ok) {
+        error = "the trace is truncated";
+    }
+    return ok;
+}
+
+bool Reader::ReadNumber(u64& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (position == data.size()) {
+            return false;
+        }
+        const u8 byte = data[position++];
+        value |= static_cast<u64>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Reader::ReadString(std::string& value) {
+    u64 size;
+    if (!ReadNumber(size) || size > data.size() - position) {
+        return false;
+    }
+    value.assign(reinterpret_cast<const char*>(data.data() + position), size);
+    position += size;
+    return true;
+}
+
+} // namespace InputTrace
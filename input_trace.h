@@ -0,0 +1,122 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common_types.h"
+
+struct ButtonBinding;
+
+/**
+ * Opt-in recording of what vvctre hands the plugin, so a session can be replayed against a mock
+ * host by bench/trace_replay.cpp.
+ * A trace is a TraceHeader followed by events, each an Event byte and its payload. Numbers are
+ * LEB128 varints and strings are a length followed by the bytes. Consecutive frames with the same
+ * button state are one event, so idle frames cost nothing but a counter increment.
+ */
+namespace InputTrace {
+
+struct TraceHeader {
+    u32 magic;
+    u32 version;
+};
+
+constexpr u32 TRACE_MAGIC = 0x544C4343; // CCLT
+constexpr u32 TRACE_VERSION = 1;
+
+enum class Event : u8 {
+    /// The contents of the settings file. Starts every trace, and follows every reload.
+    Settings,
+    /// A count followed by the button parameters of every binding, bit i of button states being
+    /// binding i. Follows every Settings event.
+    Bindings,
+    /// Replays load the settings with it, so it's recorded right after the first Bindings event.
+    InitialSettingsOpening,
+    EmulationStarting,
+    /// Ends the trace
+    EmulatorClosing,
+    /// A frame count followed by the button state during those frames. A frame is
+    /// BeforeDrawingFPS followed by AddMenu.
+    Frames,
+    /// The label of a menu item clicked in the AddMenu of the last frame
+    MenuClick,
+    Count,
+};
+
+class Recorder {
+public:
+    ~Recorder();
+
+    /// Starts a trace with the contents of the settings file and the bindings.
+    bool Start(const std::string& output_path, const std::vector<u8>& settings_contents,
+               const std::vector<ButtonBinding>& bindings);
+    void Stop();
+
+    bool IsRecording() const {
+        return file != nullptr;
+    }
+
+    /// Records reloaded settings.
+    void OnReload(const std::vector<u8>& settings_contents,
+                  const std::vector<ButtonBinding>& bindings);
+    void OnHook(Event event);
+    void OnMenuClick(const char* label);
+
+    void OnFrame(u64 button_state) {
+        if (file == nullptr) {
+            return;
+        }
+        if (button_state != frame_button_state && frame_count != 0) {
+            FlushFrames();
+        }
+        frame_button_state = button_state;
+        ++frame_count;
+    }
+
+private:
+    void FlushFrames();
+    void WriteEvent(Event event);
+    void WriteNumber(u64 value);
+    void WriteString(const char* data, std::size_t size);
+    void WriteSettings(const std::vector<u8>& settings_contents,
+                       const std::vector<ButtonBinding>& bindings);
+    void FlushBuffer();
+
+    std::FILE* file = nullptr;
+    std::vector<u8> buffer;
+    u64 frame_count = 0;
+    u64 frame_button_state = 0;
+};
+
+struct Entry {
+    Event event = Event::Count;
+    u64 frame_count = 0;
+    u64 button_state = 0;
+    /// Settings contents, or the label of a menu item
+    std::string text;
+    std::vector<std::string> buttons;
+};
+
+class Reader {
+public:
+    bool Open(const std::string& path, std::string& error);
+
+    /// Reads the next event. Returns false at the end of the trace, with error set if the trace
+    /// is invalid.
+    bool Next(Entry& entry, std::string& error);
+
+private:
+    bool ReadNumber(u64& value);
+    bool ReadString(std::string& value);
+
+    std::vector<u8> data;
+    std::size_t position = 0;
+};
+
+} // namespace InputTrace
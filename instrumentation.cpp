@@ -0,0 +1,220 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "instrumentation.h"
+#include "string_util.h"
+
+namespace Instrumentation {
+
+std::atomic<bool> enabled{false};
+
+static std::array<Histogram, static_cast<std::size_t>(Metric::Count)> histograms;
+static std::array<std::atomic<u64>, static_cast<std::size_t>(Counter::Count)> counters{};
+
+static std::thread flush_thread;
+static std::mutex flush_mutex;
+static std::condition_variable flush_condition_variable;
+static bool stop_requested = false;
+
+// Stops the flush thread if the plugin is unloaded without EmulatorClosing being called
+static struct FlushThreadGuard {
+    ~FlushThreadGuard() {
+        Stop();
+    }
+} flush_thread_guard;
+
+static int GetMostSignificantBit(u64 value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+static std::size_t GetBucket(u64 nanoseconds) {
+    if (nanoseconds < 4) {
+        return static_cast<std::size_t>(nanoseconds);
+    }
+    const int bit = GetMostSignificantBit(nanoseconds);
+    const u64 quarter = (nanoseconds >> (bit - 2)) & 3;
+    return static_cast<std::size_t>(bit - 1) * 4 + static_cast<std::size_t>(quarter);
+}
+
+static u64 GetBucketLowerBound(std::size_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    const int bit = static_cast<int>(bucket / 4) + 1;
+    return (4 + static_cast<u64>(bucket % 4)) << (bit - 2);
+}
+
+void Histogram::Record(u64 nanoseconds) {
+    buckets[GetBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(nanoseconds, std::memory_order_relaxed);
+    u64 current_max = max.load(std::memory_order_relaxed);
+    while (nanoseconds > current_max &&
+           !max.compare_exchange_weak(current_max, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+u64 Histogram::GetCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+u64 Histogram::GetMax() const {
+    return max.load(std::memory_order_relaxed);
+}
+
+u64 Histogram::GetTotal() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+u64 Histogram::GetPercentile(double percentile) const {
+    std::array<u64, BUCKET_COUNT> snapshot;
+    u64 snapshot_count = 0;
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+        snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+        snapshot_count += snapshot[i];
+    }
+    if (snapshot_count == 0) {
+        return 0;
+    }
+
+    const u64 rank = static_cast<u64>(percentile / 100.0 * static_cast<double>(snapshot_count - 1));
+    u64 seen = 0;
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += snapshot[i];
+        if (seen > rank) {
+            return GetBucketLowerBound(i);
+        }
+    }
+    return GetBucketLowerBound(BUCKET_COUNT - 1);
+}
+
+void Record(Metric metric, u64 nanoseconds) {
+    histograms[static_cast<std::size_t>(metric)].Record(nanoseconds);
+}
+
+void Increment(Counter counter) {
+    counters[static_cast<std::size_t>(counter)].fetch_add(1, std::memory_order_relaxed);
+}
+
+const Histogram& GetHistogram(Metric metric) {
+    return histograms[static_cast<std::size_t>(metric)];
+}
+
+u64 GetCounter(Counter counter) {
+    return counters[static_cast<std::size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+const char* GetName(Metric metric) {
+    switch (metric) {
+    case Metric::BeforeDrawingFPS:
+        return "BeforeDrawingFPS";
+    case Metric::Switch:
+        return "Switch";
+    case Metric::TransitionStep:
+        return "TransitionStep";
+    case Metric::SetWindowSize:
+        return "SetWindowSize";
+    case Metric::SetWindowPosition:
+        return "SetWindowPosition";
+    case Metric::LoadSettings:
+        return "LoadSettings";
+    case Metric::InputLatency:
+        return "InputLatency";
+    case Metric::ParseLayoutPack:
+        return "ParseLayoutPack";
+    default:
+        return "";
+    }
+}
+
+const char* GetName(Counter counter) {
+    switch (counter) {
+    case Counter::Switches:
+        return "Switches";
+    case Counter::CoalescedSwitches:
+        return "CoalescedSwitches";
+    case Counter::Reloads:
+        return "Reloads";
+    default:
+        return "";
+    }
+}
+
+static void WriteSnapshot(std::ofstream& file, u64 timestamp_ms) {
+    for (std::size_t i = 0; i < histograms.size(); ++i) {
+        const Metric metric = static_cast<Metric>(i);
+        const Histogram& histogram = histograms[i];
+        file << timestamp_ms << ',' << GetName(metric) << ',' << histogram.GetCount() << ','
+             << histogram.GetTotal() << ',' << histogram.GetPercentile(50.0) << ','
+             << histogram.GetPercentile(99.0) << ',' << histogram.GetMax() << '\n';
+    }
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+        file << timestamp_ms << ',' << GetName(static_cast<Counter>(i)) << ','
+             << counters[i].load(std::memory_order_relaxed) << ",,,,\n";
+    }
+    file.flush();
+}
+
+static void FlushThread(std::string output_path, u32 flush_interval_ms) {
+    std::ofstream file;
+#ifdef _MSC_VER
+    file.open(Common::UTF8ToUTF16W(output_path), std::ios::trunc);
+#else
+    file.open(output_path, std::ios::trunc);
+#endif
+    if (file.fail()) {
+        return;
+    }
+    file << "timestamp_ms,name,count,total_ns,p50_ns,p99_ns,max_ns\n";
+
+    const u64 start = Now();
+    std::unique_lock<std::mutex> lock(flush_mutex);
+    while (true) {
+        const bool stop = flush_condition_variable.wait_for(
+            lock, std::chrono::milliseconds(flush_interval_ms), [] { return stop_requested; });
+        WriteSnapshot(file, (Now() - start) / 1000000);
+        if (stop) {
+            return;
+        }
+    }
+}
+
+void Start(const std::string& output_path, u32 flush_interval_ms) {
+    Stop();
+
+    enabled.store(true, std::memory_order_relaxed);
+    stop_requested = false;
+    flush_thread =
+        std::thread(FlushThread, output_path, flush_interval_ms == 0 ? 1 : flush_interval_ms);
+}
+
+void Stop() {
+    enabled.store(false, std::memory_order_relaxed);
+    if (!flush_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex);
+        stop_requested = true;
+    }
+    flush_condition_variable.notify_one();
+    flush_thread.join();
+}
+
+} // namespace Instrumentation
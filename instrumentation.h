@@ -0,0 +1,113 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include "common_types.h"
+
+/**
+ * Opt-in timing of the plugin's hot paths.
+ * Durations go into fixed-bucket histograms made of relaxed atomics, so recording never locks or
+ * allocates. A background thread appends snapshots to a CSV file.
+ */
+namespace Instrumentation {
+
+enum class Metric {
+    BeforeDrawingFPS,
+    /// From the frame that noticed the button release to the layout being applied
+    Switch,
+    /// One frame of a layout transition
+    TransitionStep,
+    SetWindowSize,
+    SetWindowPosition,
+    LoadSettings,
+    /// From the input polling thread seeing a release to the frame running its action
+    InputLatency,
+    /// One layout pack, on one of the threads parsing them
+    ParseLayoutPack,
+    Count,
+};
+
+enum class Counter {
+    Switches,
+    /// Switches that weren't pushed to vvctre because another one followed quickly
+    CoalescedSwitches,
+    Reloads,
+    Count,
+};
+
+/**
+ * Values below 4 ns get their own bucket, then every power of two is split in 4 buckets, so
+ * percentiles are within 25% of the real value.
+ */
+class Histogram {
+public:
+    static constexpr std::size_t BUCKET_COUNT = 252;
+
+    void Record(u64 nanoseconds);
+
+    u64 GetCount() const;
+    u64 GetMax() const;
+    u64 GetTotal() const;
+    /// Returns the lower bound of the bucket containing the percentile, 0 if nothing was recorded.
+    u64 GetPercentile(double percentile) const;
+
+private:
+    std::array<std::atomic<u64>, BUCKET_COUNT> buckets{};
+    std::atomic<u64> count{0};
+    std::atomic<u64> total{0};
+    std::atomic<u64> max{0};
+};
+
+extern std::atomic<bool> enabled;
+
+inline bool IsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+/// Records a duration even when instrumentation is disabled.
+void Record(Metric metric, u64 nanoseconds);
+void Increment(Counter counter);
+
+const Histogram& GetHistogram(Metric metric);
+u64 GetCounter(Counter counter);
+const char* GetName(Metric metric);
+const char* GetName(Counter counter);
+
+/// Enables recording and starts the thread that appends snapshots to output_path.
+void Start(const std::string& output_path, u32 flush_interval_ms);
+/// Disables recording, writes a last snapshot, and stops the flush thread.
+void Stop();
+
+inline u64 Now() {
+    return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now().time_since_epoch())
+                                .count());
+}
+
+/// Records the lifetime of the timer if instrumentation was enabled when it was created.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Metric metric_) : metric(metric_), start(IsEnabled() ? Now() : 0) {}
+    ~ScopedTimer() {
+        if (start != 0) {
+            Record(metric, Now() - start);
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Metric metric;
+    u64 start;
+};
+
+} // namespace Instrumentation
@@ -0,0 +1,445 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <limits>
+
+#include "json_reader.h"
+#include "layout_cache.h"
+
+JsonReader::JsonReader(std::FILE* file_, ContentHasher* hasher_)
+    : file(file_), hasher(hasher_), buffer(new char[BUFFER_SIZE]) {
+    position = limit = buffer;
+}
+
+JsonReader::JsonReader(const char* data, std::size_t size) : position(data), limit(data + size) {}
+
+JsonReader::~JsonReader() {
+    delete[] buffer;
+}
+
+bool JsonReader::Refill() {
+    if (file == nullptr) {
+        return false;
+    }
+    const std::size_t count = std::fread(buffer, 1, BUFFER_SIZE, file);
+    if (count == 0) {
+        return false;
+    }
+    if (hasher != nullptr) {
+        hasher->Update(reinterpret_cast<const u8*>(buffer), count);
+    }
+    position = buffer;
+    limit = buffer + count;
+    return true;
+}
+
+int JsonReader::SkipWhitespace() {
+    while (true) {
+        const int c = Peek();
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            return c;
+        }
+        Get();
+    }
+}
+
+void JsonReader::MarkToken() {
+    token_line = line;
+    token_column = column;
+}
+
+bool JsonReader::Fail(const std::string& message) {
+    if (!failed) {
+        failed = true;
+        error = "line " + std::to_string(token_line) + ", column " +
+                std::to_string(token_column) + ": " + message;
+    }
+    return false;
+}
+
+bool JsonReader::Expect(char expected, const char* what) {
+    if (failed) {
+        return false;
+    }
+    SkipWhitespace();
+    MarkToken();
+    if (Get() != expected) {
+        return Fail(std::string("expected ") + what);
+    }
+    return true;
+}
+
+bool JsonReader::ExpectLiteral(const char* rest) {
+    for (; *rest != '\0'; ++rest) {
+        if (Get() != *rest) {
+            return Fail("invalid literal");
+        }
+    }
+    return true;
+}
+
+bool JsonReader::Push() {
+    if (depth == MAX_DEPTH) {
+        return Fail("nested too deeply");
+    }
+    first_flags |= u64(1) << depth;
+    ++depth;
+    return true;
+}
+
+JsonReader::Type JsonReader::PeekType() {
+    if (failed) {
+        return Type::Invalid;
+    }
+    switch (SkipWhitespace()) {
+    case '{':
+        return Type::Object;
+    case '[':
+        return Type::Array;
+    case '"':
+        return Type::String;
+    case 't':
+    case 'f':
+        return Type::Bool;
+    case 'n':
+        return Type::Null;
+    case -1:
+        return Type::End;
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        return Type::Number;
+    default:
+        return Type::Invalid;
+    }
+}
+
+bool JsonReader::BeginObject() {
+    return Expect('{', "an object") && Push();
+}
+
+bool JsonReader::NextMember(std::string& key, bool& done) {
+    done = false;
+    if (failed) {
+        return false;
+    }
+
+    const u64 first_flag = u64(1) << (depth - 1);
+    SkipWhitespace();
+    MarkToken();
+    if (Peek() == '}') {
+        Get();
+        first_flags &= ~first_flag;
+        --depth;
+        done = true;
+        return true;
+    }
+    if ((first_flags & first_flag) == 0) {
+        if (Get() != ',') {
+            return Fail("expected , or }");
+        }
+        SkipWhitespace();
+        MarkToken();
+    }
+    first_flags &= ~first_flag;
+
+    if (Peek() != '"') {
+        return Fail("expected a key");
+    }
+    return ReadString(key) && Expect(':', ":");
+}
+
+bool JsonReader::BeginArray() {
+    return Expect('[', "an array") && Push();
+}
+
+bool JsonReader::NextElement(bool& done) {
+    done = false;
+    if (failed) {
+        return false;
+    }
+
+    const u64 first_flag = u64(1) << (depth - 1);
+    SkipWhitespace();
+    MarkToken();
+    if (Peek() == ']') {
+        Get();
+        first_flags &= ~first_flag;
+        --depth;
+        done = true;
+        return true;
+    }
+    if ((first_flags & first_flag) == 0) {
+        if (Get() != ',') {
+            return Fail("expected , or ]");
+        }
+    }
+    first_flags &= ~first_flag;
+    return true;
+}
+
+bool JsonReader::ReadHexDigits(u32& value) {
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        const int c = Get();
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= static_cast<u32>(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value |= static_cast<u32>(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            value |= static_cast<u32>(c - 'A' + 10);
+        } else {
+            return Fail("invalid \\u escape");
+        }
+    }
+    return true;
+}
+
+bool JsonReader::ReadString(std::string& value) {
+    if (!Expect('"', "a string")) {
+        return false;
+    }
+
+    value.clear();
+    while (true) {
+        const int c = Get();
+        if (c == '"') {
+            return true;
+        }
+        if (c == -1) {
+            return Fail("unterminated string");
+        }
+        if (c < 0x20) {
+            return Fail("control character in string");
+        }
+        if (c != '\\') {
+            value.push_back(static_cast<char>(c));
+            continue;
+        }
+
+        switch (Get()) {
+        case '"':
+            value.push_back('"');
+            break;
+        case '\\':
+            value.push_back('\\');
+            break;
+        case '/':
+            value.push_back('/');
+            break;
+        case 'b':
+            value.push_back('\b');
+            break;
+        case 'f':
+            value.push_back('\f');
+            break;
+        case 'n':
+            value.push_back('\n');
+            break;
+        case 'r':
+            value.push_back('\r');
+            break;
+        case 't':
+            value.push_back('\t');
+            break;
+        case 'u': {
+            u32 code_point;
+            if (!ReadHexDigits(code_point)) {
+                return false;
+            }
+            if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                u32 low;
+                if (Get() != '\\' || Get() != 'u' || !ReadHexDigits(low) || low < 0xDC00 ||
+                    low > 0xDFFF) {
+                    return Fail("invalid surrogate pair");
+                }
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            }
+            if (code_point < 0x80) {
+                value.push_back(static_cast<char>(code_point));
+            } else if (code_point < 0x800) {
+                value.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+                value.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            } else if (code_point < 0x10000) {
+                value.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+                value.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                value.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            } else {
+                value.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+                value.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+                value.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                value.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            break;
+        }
+        default:
+            return Fail("invalid escape");
+        }
+    }
+}
+
+bool JsonReader::ReadBool(bool& value) {
+    if (failed) {
+        return false;
+    }
+    SkipWhitespace();
+    MarkToken();
+    switch (Get()) {
+    case 't':
+        value = true;
+        return ExpectLiteral("rue");
+    case 'f':
+        value = false;
+        return ExpectLiteral("alse");
+    default:
+        return Fail("expected true or false");
+    }
+}
+
+bool JsonReader::ReadInteger(s64& value) {
+    return ReadInteger(value, std::numeric_limits<s64>::min(), std::numeric_limits<s64>::max());
+}
+
+bool JsonReader::ReadInteger(s64& value, s64 min, s64 max) {
+    if (failed) {
+        return false;
+    }
+    SkipWhitespace();
+    MarkToken();
+
+    const bool negative = Peek() == '-';
+    if (negative) {
+        Get();
+    }
+    if (Peek() < '0' || Peek() > '9') {
+        return Fail("expected an integer");
+    }
+
+    // Accumulated as a negative number so the minimum value fits
+    s64 result = 0;
+    while (Peek() >= '0' && Peek() <= '9') {
+        const int digit = Get() - '0';
+        if (result < (std::numeric_limits<s64>::min() + digit) / 10) {
+            return Fail("integer out of range");
+        }
+        result = result * 10 - digit;
+    }
+    if (Peek() == '.' || Peek() == 'e' || Peek() == 'E') {
+        return Fail("expected an integer");
+    }
+    if (!negative) {
+        if (result == std::numeric_limits<s64>::min()) {
+            return Fail("integer out of range");
+        }
+        result = -result;
+    }
+    if (result < min || result > max) {
+        return Fail("expected an integer from " + std::to_string(min) + " to " +
+                    std::to_string(max));
+    }
+
+    value = result;
+    return true;
+}
+
+bool JsonReader::SkipNumber() {
+    MarkToken();
+    if (Peek() == '-') {
+        Get();
+    }
+    if (Peek() < '0' || Peek() > '9') {
+        return Fail("invalid number");
+    }
+    while (Peek() >= '0' && Peek() <= '9') {
+        Get();
+    }
+    if (Peek() == '.') {
+        Get();
+        if (Peek() < '0' || Peek() > '9') {
+            return Fail("invalid number");
+        }
+        while (Peek() >= '0' && Peek() <= '9') {
+            Get();
+        }
+    }
+    if (Peek() == 'e' || Peek() == 'E') {
+        Get();
+        if (Peek() == '+' || Peek() == '-') {
+            Get();
+        }
+        if (Peek() < '0' || Peek() > '9') {
+            return Fail("invalid number");
+        }
+        while (Peek() >= '0' && Peek() <= '9') {
+            Get();
+        }
+    }
+    return true;
+}
+
+bool JsonReader::SkipValue() {
+    std::string ignored;
+    bool done;
+    switch (PeekType()) {
+    case Type::Object:
+        if (!BeginObject()) {
+            return false;
+        }
+        while (NextMember(ignored, done) && !done) {
+            if (!SkipValue()) {
+                return false;
+            }
+        }
+        return !failed;
+    case Type::Array:
+        if (!BeginArray()) {
+            return false;
+        }
+        while (NextElement(done) && !done) {
+            if (!SkipValue()) {
+                return false;
+            }
+        }
+        return !failed;
+    case Type::String:
+        return ReadString(ignored);
+    case Type::Number:
+        return SkipNumber();
+    case Type::Bool: {
+        bool value;
+        return ReadBool(value);
+    }
+    case Type::Null:
+        MarkToken();
+        Get();
+        return ExpectLiteral("ull");
+    case Type::End:
+        MarkToken();
+        return Fail("unexpected end of input");
+    default:
+        MarkToken();
+        return Fail("unexpected character");
+    }
+}
+
+bool JsonReader::End() {
+    if (failed) {
+        return false;
+    }
+    SkipWhitespace();
+    MarkToken();
+    if (Peek() != -1) {
+        return Fail("unexpected data after the settings");
+    }
+    return true;
+}
@@ -0,0 +1,136 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#include "common_types.h"
+
+class ContentHasher;
+
+/**
+ * A pull JSON reader. It reads files through a fixed-size buffer and never builds a document, so
+ * its memory use doesn't depend on the size of the input.
+ * Nothing throws: the first error is kept with its line and column, and every later call fails.
+ *
+ * Objects are read with BeginObject followed by NextMember until done is set, arrays with
+ * BeginArray followed by NextElement until done is set, and every member or element must be read
+ * or skipped before asking for the next one.
+ */
+class JsonReader {
+public:
+    enum class Type {
+        Object,
+        Array,
+        String,
+        Number,
+        Bool,
+        Null,
+        End,
+        Invalid,
+    };
+
+    static constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+    static constexpr int MAX_DEPTH = 64;
+
+    /// Reads from a file opened in binary mode. hasher, if given, receives every byte read.
+    explicit JsonReader(std::FILE* file, ContentHasher* hasher = nullptr);
+    JsonReader(const char* data, std::size_t size);
+    ~JsonReader();
+
+    JsonReader(const JsonReader&) = delete;
+    JsonReader& operator=(const JsonReader&) = delete;
+
+    Type PeekType();
+
+    bool BeginObject();
+    bool NextMember(std::string& key, bool& done);
+    bool BeginArray();
+    bool NextElement(bool& done);
+
+    bool ReadString(std::string& value);
+    bool ReadBool(bool& value);
+    bool ReadInteger(s64& value);
+    /// Reads an integer and fails if it's outside [min, max].
+    bool ReadInteger(s64& value, s64 min, s64 max);
+    bool SkipValue();
+
+    /// Fails unless only whitespace is left.
+    bool End();
+
+    /// Records an error at the start of the last value or key read. Always returns false.
+    bool Fail(const std::string& message);
+    bool HasFailed() const {
+        return failed;
+    }
+    /// The first error, formatted as "line L, column C: message".
+    const std::string& GetError() const {
+        return error;
+    }
+
+    /// Appends every character consumed from now on to capture, until StopCapture.
+    void StartCapture(std::string* capture_) {
+        capture = capture_;
+    }
+    void StopCapture() {
+        capture = nullptr;
+    }
+
+private:
+    int Peek() {
+        if (position == limit && !Refill()) {
+            return -1;
+        }
+        return static_cast<unsigned char>(*position);
+    }
+
+    int Get() {
+        const int c = Peek();
+        if (c == -1) {
+            return -1;
+        }
+        ++position;
+        if (c == '\n') {
+            ++line;
+            column = 1;
+        } else {
+            ++column;
+        }
+        if (capture != nullptr) {
+            capture->push_back(static_cast<char>(c));
+        }
+        return c;
+    }
+
+    bool Refill();
+    int SkipWhitespace();
+    void MarkToken();
+    bool Expect(char expected, const char* what);
+    bool ExpectLiteral(const char* rest);
+    bool Push();
+    bool ReadHexDigits(u32& value);
+    bool SkipNumber();
+
+    std::FILE* file = nullptr;
+    ContentHasher* hasher = nullptr;
+    char* buffer = nullptr;
+    const char* position = nullptr;
+    const char* limit = nullptr;
+
+    u32 line = 1;
+    u32 column = 1;
+    u32 token_line = 1;
+    u32 token_column = 1;
+
+    /// Bit n is set while the container at depth n+1 hasn't had a member or element yet
+    u64 first_flags = 0;
+    int depth = 0;
+
+    bool failed = false;
+    std::string error;
+    std::string* capture = nullptr;
+};
@@ -0,0 +1,130 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "host.h"
+#include "instrumentation.h"
+#include "layout_applier.h"
+
+using CommandFunction = void (*)(s32 first_argument, s32 second_argument);
+
+// Indexed by LayoutCommand
+static const CommandFunction command_functions[] = {
+    [](s32 value, s32) { vvctre_settings_set_upright_screens(value != 0); },
+    [](s32 value, s32) { vvctre_settings_set_custom_layout_top_left(static_cast<u16>(value)); },
+    [](s32 value, s32) { vvctre_settings_set_custom_layout_top_top(static_cast<u16>(value)); },
+    [](s32 value, s32) { vvctre_settings_set_custom_layout_top_right(static_cast<u16>(value)); },
+    [](s32 value, s32) { vvctre_settings_set_custom_layout_top_bottom(static_cast<u16>(value)); },
+    [](s32 value, s32) { vvctre_settings_set_custom_layout_bottom_left(static_cast<u16>(value)); },
+    [](s32 value, s32) { vvctre_settings_set_custom_layout_bottom_top(static_cast<u16>(value)); },
+    [](s32 value, s32) { vvctre_settings_set_custom_layout_bottom_right(static_cast<u16>(value)); },
+    [](s32 value, s32) {
+        vvctre_settings_set_custom_layout_bottom_bottom(static_cast<u16>(value));
+    },
+    [](s32 width, s32 height) {
+        Instrumentation::ScopedTimer timer(Instrumentation::Metric::SetWindowSize);
+        vvctre_set_os_window_size(plugin_manager, width, height);
+    },
+    [](s32 x, s32 y) {
+        Instrumentation::ScopedTimer timer(Instrumentation::Metric::SetWindowPosition);
+        vvctre_set_os_window_position(plugin_manager, x, y);
+    },
+};
+static_assert(sizeof(command_functions) / sizeof(command_functions[0]) == LAYOUT_COMMAND_COUNT);
+
+void LayoutApplier::SetUseCustomLayout(bool value) {
+    if (use_custom_layout != value || (stale_mask & USE_CUSTOM_LAYOUT_STALE) != 0) {
+        vvctre_settings_set_use_custom_layout(value);
+        use_custom_layout = value;
+        stale_mask &= ~USE_CUSTOM_LAYOUT_STALE;
+        settings_changed = true;
+        ++change_count;
+    }
+}
+
+static bool IsScreenCommand(LayoutCommand command) {
+    return command >= LayoutCommand::SetTopLeft && command <= LayoutCommand::SetBottomBottom;
+}
+
+bool LayoutApplier::Run(const LayoutPrograms::Program& program, u32 index, bool defer) {
+    const std::size_t command = static_cast<std::size_t>(program.commands[index]);
+    const std::pair<s32, s32> arguments(program.first_arguments[index],
+                                        program.second_arguments[index]);
+    const u32 bit = 1u << command;
+    if (last_arguments[command] == arguments && (stale_mask & bit) == 0) {
+        return false;
+    }
+    if (!defer) {
+        command_functions[command](arguments.first, arguments.second);
+        ++change_count;
+    }
+    last_arguments[command] = arguments;
+    stale_mask &= ~bit;
+    return true;
+}
+
+void LayoutApplier::SetScreens(u32 changed_mask) {
+    const std::size_t first = static_cast<std::size_t>(LayoutCommand::SetTopLeft);
+    u16 values[8];
+    bool known = true;
+    for (std::size_t i = 0; i < 8; ++i) {
+        known &= last_arguments[first + i].has_value();
+        values[i] = known ? static_cast<u16>(last_arguments[first + i]->first) : 0;
+    }
+
+    if (known) {
+        vvctre_settings_set_custom_layout(values[0], values[1], values[2], values[3], values[4],
+                                          values[5], values[6], values[7]);
+        ++change_count;
+        return;
+    }
+    // The batched setter would reset the values that were never set
+    for (std::size_t i = 0; i < 8; ++i) {
+        if ((changed_mask & (1u << i)) != 0) {
+            command_functions[first + i](last_arguments[first + i]->first, 0);
+            ++change_count;
+        }
+    }
+}
+
+void LayoutApplier::Apply(const LayoutPrograms::Program& program, bool apply_settings) {
+    SetUseCustomLayout(true);
+
+    // With the batched setter, the screen commands only record their arguments, and the changed
+    // rectangles are set in one call
+    const bool batch_screens = vvctre_settings_set_custom_layout != nullptr;
+    u32 changed_screens = 0;
+    u32 i = 0;
+    for (; i < program.settings_size; ++i) {
+        const LayoutCommand command = program.commands[i];
+        if (batch_screens && IsScreenCommand(command)) {
+            if (Run(program, i, true)) {
+                changed_screens |= 1u << (static_cast<u32>(command) -
+                                          static_cast<u32>(LayoutCommand::SetTopLeft));
+            }
+        } else {
+            settings_changed |= Run(program, i);
+        }
+    }
+    if (changed_screens != 0) {
+        SetScreens(changed_screens);
+        settings_changed = true;
+    }
+
+    if (apply_settings && settings_changed) {
+        vvctre_settings_apply();
+        settings_changed = false;
+    }
+
+    for (; i < program.size; ++i) {
+        Run(program, i);
+    }
+}
+
+void LayoutApplier::DisableCustomLayout(bool apply_settings) {
+    SetUseCustomLayout(false);
+    if (apply_settings && settings_changed) {
+        vvctre_settings_apply();
+        settings_changed = false;
+    }
+}
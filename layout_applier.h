@@ -0,0 +1,81 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <optional>
+#include <utility>
+
+#include "common_types.h"
+#include "layout_program.h"
+
+/**
+ * Pushes layout programs to vvctre.
+ * Remembers the last arguments of every command, and only calls what differs.
+ * vvctre_settings_apply, which makes vvctre reconfigure the renderer, is only called when a
+ * setting changed. When vvctre has vvctre_settings_set_custom_layout, the screen rectangles are
+ * set with one call.
+ */
+class LayoutApplier {
+public:
+    /**
+     * apply_settings: call vvctre_settings_apply if a setting changed now or in an earlier call
+     * that didn't apply them. Leave it false before emulation starts, vvctre applies the settings
+     * then.
+     */
+    void Apply(const LayoutPrograms::Program& program, bool apply_settings);
+
+    /// Makes vvctre use its own layouts.
+    void DisableCustomLayout(bool apply_settings);
+
+    bool IsCustomLayoutEnabled() const {
+        return use_custom_layout.value_or(false);
+    }
+
+    /// Gets the arguments last pushed for a command. Returns false if it was never pushed.
+    bool GetLastArguments(LayoutCommand command, s32& first_argument,
+                          s32& second_argument) const {
+        const std::optional<std::pair<s32, s32>>& last =
+            last_arguments[static_cast<std::size_t>(command)];
+        if (!last) {
+            return false;
+        }
+        first_argument = last->first;
+        second_argument = last->second;
+        return true;
+    }
+
+    /// Counts the host calls made to change the layout, for noticing that something was pushed.
+    u32 GetChangeCount() const {
+        return change_count;
+    }
+
+    /**
+     * Stops trusting that vvctre still has the values last pushed, vvctre's menu can change them
+     * without telling the plugin. The next Apply calls every setter of its program and
+     * vvctre_settings_set_use_custom_layout. The last arguments are kept for GetLastArguments.
+     */
+    void Reset() {
+        stale_mask = ALL_STALE;
+    }
+
+private:
+    void SetUseCustomLayout(bool value);
+    /// Returns whether the arguments changed. With defer, they are only recorded.
+    bool Run(const LayoutPrograms::Program& program, u32 index, bool defer = false);
+    /// Sets the screen rectangles from the last arguments, the bits of changed_mask being the
+    /// screen commands whose arguments changed
+    void SetScreens(u32 changed_mask);
+
+    /// Bit of use_custom_layout in stale_mask, after the bits of the commands
+    static constexpr u32 USE_CUSTOM_LAYOUT_STALE = 1u << LAYOUT_COMMAND_COUNT;
+    static constexpr u32 ALL_STALE = (USE_CUSTOM_LAYOUT_STALE << 1) - 1;
+
+    std::optional<bool> use_custom_layout;
+    std::optional<std::pair<s32, s32>> last_arguments[LAYOUT_COMMAND_COUNT];
+    /// Indexed by LayoutCommand, what has to be pushed even if it didn't change
+    u32 stale_mask = 0;
+    bool settings_changed = false;
+    u32 change_count = 0;
+};
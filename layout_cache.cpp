@@ -0,0 +1,214 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "layout_cache.h"
+#include "layout_expression.h"
+#include "settings.h"
+
+std::string GetLayoutCachePath(const std::string& settings_path) {
+    const std::string::size_type extension = settings_path.rfind(".json");
+    if (extension == std::string::npos) {
+        return settings_path + ".cache";
+    }
+    return settings_path.substr(0, extension) + ".cache";
+}
+
+// FNV-1a over 8 byte words, checking the cache has to stay much cheaper than parsing
+static u64 HashWord(u64 hash, u64 word) {
+    hash ^= word;
+    hash *= 0x100000001B3;
+    return hash ^ (hash >> 29);
+}
+
+ContentHasher::ContentHasher(u64 total_size) : hash(0xCBF29CE484222325 ^ total_size) {}
+
+void ContentHasher::Update(const u8* data, std::size_t size) {
+    if (pending_size != 0) {
+        while (pending_size < sizeof(u64) && size != 0) {
+            pending[pending_size++] = *data++;
+            --size;
+        }
+        if (pending_size < sizeof(u64)) {
+            return;
+        }
+        u64 word;
+        std::memcpy(&word, pending, sizeof(word));
+        hash = HashWord(hash, word);
+        pending_size = 0;
+    }
+
+    for (; size >= sizeof(u64); data += sizeof(u64), size -= sizeof(u64)) {
+        u64 word;
+        std::memcpy(&word, data, sizeof(word));
+        hash = HashWord(hash, word);
+    }
+
+    std::memcpy(pending, data, size);
+    pending_size = size;
+}
+
+u64 ContentHasher::Finish() {
+    for (std::size_t i = 0; i < pending_size; ++i) {
+        hash ^= pending[i];
+        hash *= 0x100000001B3;
+    }
+    pending_size = 0;
+    return hash;
+}
+
+u64 HashFileContents(const u8* data, std::size_t size) {
+    ContentHasher hasher(size);
+    hasher.Update(data, size);
+    return hasher.Finish();
+}
+
+// A truncated or corrupt cache must not make LayoutTable or LayoutPrograms read outside of the
+// mapping. LayoutPrograms::Compile takes the names to be contiguous and in layout order.
+static bool AreRecordsValid(const CustomLayout* layouts, std::size_t count, const u32* code,
+                            std::size_t code_size, std::size_t names_size) {
+    const u32* code_end = code + code_size;
+    u64 names_end = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        CustomLayout layout;
+        std::memcpy(&layout, &layouts[i], sizeof(layout));
+        if (layout.name_offset != names_end || names_end + layout.name_length > names_size ||
+            layout.expression_mask >= (1u << LAYOUT_VALUE_COUNT)) {
+            return false;
+        }
+        names_end += layout.name_length;
+        if (layout.expression_mask == 0) {
+            continue;
+        }
+        if (layout.expression_code >= code_size) {
+            return false;
+        }
+        const u32* position = code + layout.expression_code;
+        for (u16 mask = layout.expression_mask; mask != 0; mask &= mask - 1) {
+            position = LayoutExpression::Validate(position, code_end);
+            if (position == nullptr) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Only makes the next start skip hashing, failing to write is fine
+static void UpdateSettingsStamp(const std::string& cache_path,
+                                const FileUtil::FileStamp& settings_stamp) {
+    std::FILE* file = FileUtil::OpenFile(cache_path, "r+b");
+    if (file == nullptr) {
+        return;
+    }
+    if (std::fseek(file, offsetof(LayoutCacheHeader, settings_modification_time), SEEK_SET) == 0) {
+        std::fwrite(&settings_stamp.modification_time, sizeof(settings_stamp.modification_time), 1,
+                    file);
+    }
+    std::fclose(file);
+}
+
+bool ReadLayoutCache(const std::string& cache_path, const std::string& settings_path,
+                     const FileUtil::FileStamp& settings_stamp, Settings& settings) {
+    FileUtil::MappedFile cache;
+    if (!cache.Open(cache_path) || cache.Size() < sizeof(LayoutCacheHeader)) {
+        return false;
+    }
+
+    LayoutCacheHeader header;
+    std::memcpy(&header, cache.Data(), sizeof(header));
+    if (header.magic != LAYOUT_CACHE_MAGIC || header.version != LAYOUT_CACHE_VERSION ||
+        header.layout_size != sizeof(CustomLayout) ||
+        header.settings_size != settings_stamp.size) {
+        return false;
+    }
+
+    const std::size_t layouts_size = static_cast<std::size_t>(header.layout_count) *
+                                     sizeof(CustomLayout);
+    const std::size_t expression_code_size =
+        static_cast<std::size_t>(header.expression_code_size) * sizeof(u32);
+    if (cache.Size() != sizeof(LayoutCacheHeader) + layouts_size + expression_code_size +
+                            header.names_size + header.options_length) {
+        return false;
+    }
+
+    // The file is only hashed when its modification time changed, so copying or touching it
+    // without changing it keeps the cache. Whole seconds can't tell quick edits apart.
+    const bool stamp_changed =
+        header.settings_modification_time != settings_stamp.modification_time;
+    if (stamp_changed || !FileUtil::PRECISE_FILE_STAMPS) {
+        FileUtil::MappedFile settings_file;
+        if (!settings_file.Open(settings_path) ||
+            HashFileContents(settings_file.Data(), settings_file.Size()) != header.settings_hash) {
+            return false;
+        }
+    }
+
+    const u8* layouts = cache.Data() + sizeof(LayoutCacheHeader);
+    const u8* expression_code = layouts + layouts_size;
+    const char* names = reinterpret_cast<const char*>(expression_code + expression_code_size);
+    const char* options = names + header.names_size;
+    if (!AreRecordsValid(reinterpret_cast<const CustomLayout*>(layouts), header.layout_count,
+                         reinterpret_cast<const u32*>(expression_code),
+                         header.expression_code_size, header.names_size)) {
+        return false;
+    }
+
+    Settings loaded;
+    std::string error;
+    if (!ParseOptions(options, header.options_length, loaded, error)) {
+        return false;
+    }
+    loaded.layouts.Assign(std::move(cache), reinterpret_cast<const CustomLayout*>(layouts),
+                          header.layout_count, reinterpret_cast<const u32*>(expression_code),
+                          header.expression_code_size, names, header.names_size);
+    settings = std::move(loaded);
+
+    if (stamp_changed) {
+        UpdateSettingsStamp(cache_path, settings_stamp);
+    }
+    return true;
+}
+
+bool WriteLayoutCache(const std::string& cache_path, const FileUtil::FileStamp& settings_stamp,
+                      u64 settings_hash, const Settings& settings, const std::string& options) {
+    LayoutCacheHeader header{};
+    header.magic = LAYOUT_CACHE_MAGIC;
+    header.version = LAYOUT_CACHE_VERSION;
+    header.layout_size = sizeof(CustomLayout);
+    header.layout_count = static_cast<u32>(settings.layouts.size());
+    header.settings_size = settings_stamp.size;
+    header.settings_modification_time = settings_stamp.modification_time;
+    header.settings_hash = settings_hash;
+    header.options_length = static_cast<u32>(options.size());
+    header.expression_code_size = static_cast<u32>(settings.layouts.GetExpressionCodeSize());
+    header.names_size = static_cast<u32>(settings.layouts.GetNames().size());
+
+    const std::size_t layouts_size = settings.layouts.size() * sizeof(CustomLayout);
+    const std::size_t expression_code_size = header.expression_code_size * sizeof(u32);
+    std::vector<u8> contents(sizeof(header) + layouts_size + expression_code_size +
+                             header.names_size + options.size());
+    u8* position = contents.data();
+    std::memcpy(position, &header, sizeof(header));
+    position += sizeof(header);
+    if (layouts_size != 0) {
+        std::memcpy(position, settings.layouts.begin(), layouts_size);
+        position += layouts_size;
+    }
+    if (expression_code_size != 0) {
+        std::memcpy(position, settings.layouts.GetExpressionCode(), expression_code_size);
+        position += expression_code_size;
+    }
+    if (header.names_size != 0) {
+        std::memcpy(position, settings.layouts.GetNames().data(), header.names_size);
+        position += header.names_size;
+    }
+    std::memcpy(position, options.data(), options.size());
+
+    return FileUtil::WriteFileAtomically(cache_path, contents.data(), contents.size());
+}
@@ -0,0 +1,73 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "common_types.h"
+#include "file_util.h"
+
+struct Settings;
+
+/**
+ * The layout cache is a binary copy of the settings file, written next to it the first time it's
+ * parsed. It starts with a LayoutCacheHeader, followed by the CustomLayout records, followed by
+ * the compiled layout expressions, followed by the layout names, followed by the rest of the
+ * settings as JSON. Everything but the JSON is used in place from a memory mapping.
+ */
+struct LayoutCacheHeader {
+    u32 magic;
+    u32 version;
+    u32 layout_size;
+    u32 layout_count;
+    u64 settings_size;
+    s64 settings_modification_time;
+    u64 settings_hash;
+    u32 options_length;
+    /// In 32-bit words
+    u32 expression_code_size;
+    u32 names_size;
+    u8 padding[4];
+};
+static_assert(sizeof(LayoutCacheHeader) == 56);
+
+constexpr u32 LAYOUT_CACHE_MAGIC = 0x434C4343; // CCLC
+constexpr u32 LAYOUT_CACHE_VERSION = 5;
+
+/// Returns the path of the layout cache for a settings file.
+std::string GetLayoutCachePath(const std::string& settings_path);
+
+/// Fast 64-bit hash of a file's contents, used to check that the layout cache is up to date.
+u64 HashFileContents(const u8* data, std::size_t size);
+
+/// Computes HashFileContents over data given in pieces.
+class ContentHasher {
+public:
+    explicit ContentHasher(u64 total_size);
+
+    void Update(const u8* data, std::size_t size);
+    u64 Finish();
+
+private:
+    u64 hash;
+    u8 pending[8];
+    std::size_t pending_size = 0;
+};
+
+/**
+ * Loads settings from a layout cache if it was written for the current settings file.
+ * The cache is current if the settings file has the size and modification time it was written for.
+ * Only a file with another modification time is hashed, and if its contents didn't change the
+ * cache is updated with the new modification time. Without FileUtil::PRECISE_FILE_STAMPS, the
+ * file is always hashed.
+ * Returns false without touching settings if the cache is missing, invalid, or stale.
+ */
+bool ReadLayoutCache(const std::string& cache_path, const std::string& settings_path,
+                     const FileUtil::FileStamp& settings_stamp, Settings& settings);
+
+/// options is the settings file without the layouts, as JSON.
+bool WriteLayoutCache(const std::string& cache_path, const FileUtil::FileStamp& settings_stamp,
+                      u64 settings_hash, const Settings& settings, const std::string& options);
@@ -0,0 +1,355 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "layout_expression.h"
+
+namespace LayoutExpression {
+
+namespace {
+
+static_assert(sizeof(double) == 2 * sizeof(u32));
+
+constexpr const char* variable_names[] = {"width", "height", "top_aspect", "bottom_aspect"};
+static_assert(sizeof(variable_names) / sizeof(variable_names[0]) ==
+              static_cast<std::size_t>(Variable::Count));
+
+u32 MakeInstruction(OpCode op_code, u32 operand = 0) {
+    return static_cast<u32>(op_code) | (operand << 8);
+}
+
+/// A recursive descent compiler that tracks the stack depth the bytecode will need.
+class Compiler {
+public:
+    Compiler(const std::string& source_, std::vector<u32>& code_) : source(source_), code(code_) {}
+
+    bool Run(std::string& error_) {
+        const std::size_t start = code.size();
+        bool ok = CompileSum();
+        SkipSpaces();
+        if (ok && position != source.size()) {
+            ok = Fail("unexpected " + source.substr(position));
+        }
+        if (!ok) {
+            code.resize(start);
+            error_ = "invalid expression \"" + source + "\": " + error;
+            return false;
+        }
+        code.push_back(MakeInstruction(OpCode::End));
+        return true;
+    }
+
+private:
+    bool Fail(const std::string& message) {
+        if (error.empty()) {
+            error = message;
+        }
+        return false;
+    }
+
+    void SkipSpaces() {
+        while (position < source.size() && std::isspace(static_cast<unsigned char>(source[position]))) {
+            ++position;
+        }
+    }
+
+    bool Accept(char c) {
+        SkipSpaces();
+        if (position < source.size() && source[position] == c) {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    bool Push() {
+        if (++depth > MAX_STACK_DEPTH) {
+            return Fail("too complex");
+        }
+        return true;
+    }
+
+    void Emit(OpCode op_code, std::size_t operands) {
+        code.push_back(MakeInstruction(op_code));
+        depth -= operands - 1;
+    }
+
+    bool CompileSum() {
+        if (!CompileProduct()) {
+            return false;
+        }
+        while (true) {
+            if (Accept('+')) {
+                if (!CompileProduct()) {
+                    return false;
+                }
+                Emit(OpCode::Add, 2);
+            } else if (Accept('-')) {
+                if (!CompileProduct()) {
+                    return false;
+                }
+                Emit(OpCode::Subtract, 2);
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool CompileProduct() {
+        if (!CompileUnary()) {
+            return false;
+        }
+        while (true) {
+            OpCode op_code;
+            if (Accept('*')) {
+                op_code = OpCode::Multiply;
+            } else if (Accept('/')) {
+                op_code = OpCode::Divide;
+            } else if (Accept('%')) {
+                op_code = OpCode::Modulo;
+            } else {
+                return true;
+            }
+            if (!CompileUnary()) {
+                return false;
+            }
+            Emit(op_code, 2);
+        }
+    }
+
+    bool CompileUnary() {
+        if (Accept('-')) {
+            if (!CompileUnary()) {
+                return false;
+            }
+            Emit(OpCode::Negate, 1);
+            return true;
+        }
+        if (Accept('+')) {
+            return CompileUnary();
+        }
+        return CompilePrimary();
+    }
+
+    bool CompilePrimary() {
+        SkipSpaces();
+        if (position == source.size()) {
+            return Fail("unexpected end");
+        }
+
+        if (Accept('(')) {
+            return CompileSum() && (Accept(')') || Fail("expected )"));
+        }
+
+        const char c = source[position];
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            char* end;
+            const double value = std::strtod(source.c_str() + position, &end);
+            if (end == source.c_str() + position) {
+                return Fail("invalid number");
+            }
+            position = static_cast<std::size_t>(end - source.c_str());
+            u32 bits[2];
+            std::memcpy(bits, &value, sizeof(bits));
+            code.push_back(MakeInstruction(OpCode::PushConstant));
+            code.insert(code.end(), bits, bits + 2);
+            return Push();
+        }
+
+        if (!std::isalpha(static_cast<unsigned char>(c)) && c != '_') {
+            return Fail(std::string("unexpected ") + c);
+        }
+        const std::size_t name_start = position;
+        while (position < source.size() &&
+               (std::isalnum(static_cast<unsigned char>(source[position])) ||
+                source[position] == '_')) {
+            ++position;
+        }
+        const std::string name = source.substr(name_start, position - name_start);
+
+        for (std::size_t i = 0; i < static_cast<std::size_t>(Variable::Count); ++i) {
+            if (name == variable_names[i]) {
+                code.push_back(MakeInstruction(OpCode::PushVariable, static_cast<u32>(i)));
+                return Push();
+            }
+        }
+
+        struct Function {
+            const char* name;
+            OpCode op_code;
+            std::size_t arguments;
+        };
+        static constexpr Function functions[] = {
+            {"min", OpCode::Min, 2},     {"max", OpCode::Max, 2},     {"floor", OpCode::Floor, 1},
+            {"ceil", OpCode::Ceil, 1},   {"round", OpCode::Round, 1}, {"abs", OpCode::Abs, 1},
+        };
+        for (const Function& function : functions) {
+            if (name != function.name) {
+                continue;
+            }
+            if (!Accept('(')) {
+                return Fail("expected ( after " + name);
+            }
+            for (std::size_t i = 0; i < function.arguments; ++i) {
+                if ((i != 0 && !Accept(',') && !Fail("expected , in " + name)) || !CompileSum()) {
+                    return false;
+                }
+            }
+            if (!Accept(')')) {
+                return Fail("expected ) after the arguments of " + name);
+            }
+            Emit(function.op_code, function.arguments);
+            return true;
+        }
+
+        return Fail("unknown name " + name);
+    }
+
+    const std::string& source;
+    std::vector<u32>& code;
+    std::size_t position = 0;
+    std::size_t depth = 0;
+    std::string error;
+};
+
+} // Anonymous namespace
+
+bool Compile(const std::string& source, std::vector<u32>& code, std::string& error) {
+    return Compiler(source, code).Run(error);
+}
+
+double Evaluate(const u32* code, const double* variables, const u32** next) {
+    double stack[MAX_STACK_DEPTH];
+    std::size_t size = 0;
+
+    while (true) {
+        const u32 instruction = *code++;
+        switch (static_cast<OpCode>(instruction & 0xFF)) {
+        case OpCode::End:
+            if (next != nullptr) {
+                *next = code;
+            }
+            return stack[0];
+        case OpCode::PushConstant:
+            std::memcpy(&stack[size++], code, sizeof(double));
+            code += 2;
+            break;
+        case OpCode::PushVariable:
+            stack[size++] = variables[instruction >> 8];
+            break;
+        case OpCode::Add:
+            --size;
+            stack[size - 1] += stack[size];
+            break;
+        case OpCode::Subtract:
+            --size;
+            stack[size - 1] -= stack[size];
+            break;
+        case OpCode::Multiply:
+            --size;
+            stack[size - 1] *= stack[size];
+            break;
+        case OpCode::Divide:
+            --size;
+            stack[size - 1] /= stack[size];
+            break;
+        case OpCode::Modulo:
+            --size;
+            stack[size - 1] = std::fmod(stack[size - 1], stack[size]);
+            break;
+        case OpCode::Negate:
+            stack[size - 1] = -stack[size - 1];
+            break;
+        case OpCode::Min:
+            --size;
+            stack[size - 1] = std::min(stack[size - 1], stack[size]);
+            break;
+        case OpCode::Max:
+            --size;
+            stack[size - 1] = std::max(stack[size - 1], stack[size]);
+            break;
+        case OpCode::Floor:
+            stack[size - 1] = std::floor(stack[size - 1]);
+            break;
+        case OpCode::Ceil:
+            stack[size - 1] = std::ceil(stack[size - 1]);
+            break;
+        case OpCode::Round:
+            stack[size - 1] = std::round(stack[size - 1]);
+            break;
+        case OpCode::Abs:
+            stack[size - 1] = std::abs(stack[size - 1]);
+            break;
+        case OpCode::Count:
+            break;
+        }
+    }
+}
+
+const u32* Skip(const u32* code) {
+    while (true) {
+        const OpCode op_code = static_cast<OpCode>(*code++ & 0xFF);
+        if (op_code == OpCode::End) {
+            return code;
+        }
+        if (op_code == OpCode::PushConstant) {
+            code += 2;
+        }
+    }
+}
+
+const u32* Validate(const u32* code, const u32* end) {
+    std::size_t size = 0;
+    while (code < end) {
+        const u32 instruction = *code++;
+        switch (static_cast<OpCode>(instruction & 0xFF)) {
+        case OpCode::End:
+            return size == 1 ? code : nullptr;
+        case OpCode::PushConstant:
+            if (size == MAX_STACK_DEPTH || end - code < 2) {
+                return nullptr;
+            }
+            code += 2;
+            ++size;
+            break;
+        case OpCode::PushVariable:
+            if (size == MAX_STACK_DEPTH || (instruction >> 8) >= static_cast<u32>(Variable::Count)) {
+                return nullptr;
+            }
+            ++size;
+            break;
+        case OpCode::Add:
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Divide:
+        case OpCode::Modulo:
+        case OpCode::Min:
+        case OpCode::Max:
+            if (size < 2) {
+                return nullptr;
+            }
+            --size;
+            break;
+        case OpCode::Negate:
+        case OpCode::Floor:
+        case OpCode::Ceil:
+        case OpCode::Round:
+        case OpCode::Abs:
+            if (size == 0) {
+                return nullptr;
+            }
+            break;
+        default:
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace LayoutExpression
@@ -0,0 +1,76 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common_types.h"
+
+/**
+ * Layout values can be expressions such as "width / 2" or "min(height * top_aspect, width)".
+ * They're compiled once when settings are loaded into a stack bytecode, and only evaluated when a
+ * layout is applied.
+ *
+ * Supported: numbers, the variables below, + - * / %, unary -, parentheses, and the functions
+ * min(a, b), max(a, b), floor(a), ceil(a), round(a) and abs(a).
+ */
+namespace LayoutExpression {
+
+enum class Variable : u8 {
+    /// Width of the window the layout is shown in
+    Width,
+    /// Height of the window the layout is shown in
+    Height,
+    /// Width / height of the 3DS top screen (5/3)
+    TopAspect,
+    /// Width / height of the 3DS bottom screen (4/3)
+    BottomAspect,
+    Count,
+};
+
+/// Instructions are 32-bit words, the op code in the low 8 bits and an operand in the others.
+enum class OpCode : u8 {
+    End,
+    /// The next two words are the constant, as the bits of a f64, so integers stay exact
+    PushConstant,
+    PushVariable,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Modulo,
+    Negate,
+    Min,
+    Max,
+    Floor,
+    Ceil,
+    Round,
+    Abs,
+    Count,
+};
+
+constexpr std::size_t MAX_STACK_DEPTH = 32;
+
+/// Compiles source and appends the bytecode, terminated by OpCode::End, to code.
+bool Compile(const std::string& source, std::vector<u32>& code, std::string& error);
+
+/**
+ * Evaluates the bytecode starting at code, which must come from Compile.
+ * Returns the position after its OpCode::End in next.
+ */
+double Evaluate(const u32* code, const double* variables, const u32** next);
+
+/// Returns the position after the OpCode::End of the bytecode starting at code.
+const u32* Skip(const u32* code);
+
+/**
+ * Checks that the bytecode starting at code is an expression Evaluate can run without reading at
+ * or after end, or outside of its stack. For bytecode that doesn't come from Compile, such as a
+ * layout cache's. Returns the position after its OpCode::End, or nullptr if it's invalid.
+ */
+const u32* Validate(const u32* code, const u32* end);
+
+} // namespace LayoutExpression
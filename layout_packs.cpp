@@ -0,0 +1,220 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "file_util.h"
+#include "instrumentation.h"
+#include "layout_cache.h"
+#include "layout_expression.h"
+#include "layout_packs.h"
+
+namespace {
+
+constexpr std::size_t MAX_THREAD_COUNT = 4;
+
+struct Pack {
+    std::string path;
+    std::vector<CustomLayout> layouts;
+    std::vector<u32> expression_code;
+    std::vector<char> names;
+    u64 parse_ns = 0;
+    std::string error;
+};
+
+bool IsSeparator(char c) {
+    return c == '/' || c == '\\';
+}
+
+std::vector<std::string> GetPackPaths(const std::string& settings_path,
+                                      const std::vector<std::string>& entries) {
+    const std::string::size_type separator = settings_path.find_last_of("/\\");
+    const std::string folder =
+        separator == std::string::npos ? std::string() : settings_path.substr(0, separator + 1);
+
+    std::vector<std::string> paths;
+    for (const std::string& entry : entries) {
+        const bool absolute = IsSeparator(entry[0]) || (entry.size() > 1 && entry[1] == ':');
+        const std::string path = absolute ? entry : folder + entry;
+        if (!IsSeparator(path.back())) {
+            paths.push_back(path);
+            continue;
+        }
+        std::vector<std::string> names = FileUtil::ListFiles(path, ".json");
+        std::sort(names.begin(), names.end());
+        for (const std::string& name : names) {
+            paths.push_back(path + name);
+        }
+    }
+    return paths;
+}
+
+void ParsePacks(std::vector<Pack>& packs) {
+    std::atomic<std::size_t> next{0};
+    const auto parse = [&packs, &next] {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < packs.size();) {
+            Pack& pack = packs[i];
+            const u64 start = Instrumentation::Now();
+            ParseLayoutPack(pack.path, pack.layouts, pack.expression_code, pack.names, pack.error);
+            pack.parse_ns = Instrumentation::Now() - start;
+            Instrumentation::Record(Instrumentation::Metric::ParseLayoutPack, pack.parse_ns);
+        }
+    };
+
+    const std::size_t thread_count =
+        std::min({packs.size(), MAX_THREAD_COUNT,
+                  std::max<std::size_t>(std::thread::hardware_concurrency(), 1)});
+    // This thread parses too
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(parse);
+    }
+    parse();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+/**
+ * Appends what decides how a layout looks to key: whether it's upright, its screens, and its
+ * window options if they are enabled, expressions as their bytecode.
+ * Returns the end of the layout's bytecode in code.
+ */
+const u32* AppendLayoutKey(const CustomLayout& layout, const u32* code, std::vector<u32>& key) {
+    const int values[] = {
+        layout.top_screen.left,     layout.top_screen.top,        layout.top_screen.right,
+        layout.top_screen.bottom,   layout.bottom_screen.left,    layout.bottom_screen.top,
+        layout.bottom_screen.right, layout.bottom_screen.bottom,  layout.resize_window.width,
+        layout.resize_window.height, layout.move_window.x,        layout.move_window.y,
+    };
+    static_assert(sizeof(values) / sizeof(values[0]) == LAYOUT_VALUE_COUNT);
+    const bool enabled[] = {
+        true, true, true, true, true, true, true, true,
+        layout.resize_window.enabled, layout.resize_window.enabled,
+        layout.move_window.enabled, layout.move_window.enabled,
+    };
+
+    key.push_back(layout.upright.has_value() ? 1 + static_cast<u32>(*layout.upright) : 0);
+    key.push_back(static_cast<u32>(layout.resize_window.enabled) |
+                  static_cast<u32>(layout.move_window.enabled) << 1);
+    if (layout.expression_mask != 0) {
+        code += layout.expression_code;
+    }
+    for (std::size_t i = 0; i < LAYOUT_VALUE_COUNT; ++i) {
+        const bool expression = (layout.expression_mask & (1u << i)) != 0;
+        const u32* end = expression ? LayoutExpression::Skip(code) : code;
+        if (enabled[i]) {
+            key.push_back(static_cast<u32>(expression));
+            if (expression) {
+                key.insert(key.end(), code, end);
+            } else {
+                key.push_back(static_cast<u32>(values[i]));
+            }
+        }
+        code = end;
+    }
+    return code;
+}
+
+u64 Hash(const std::vector<u32>& key) {
+    ContentHasher hasher(key.size());
+    hasher.Update(reinterpret_cast<const u8*>(key.data()), key.size() * sizeof(u32));
+    return hasher.Finish();
+}
+
+/// The layouts being merged, with the hashes of their keys to find duplicates
+class Merger {
+public:
+    explicit Merger(const LayoutTable& table)
+        : layouts(table.begin(), table.end()),
+          expression_code(table.GetExpressionCode(),
+                          table.GetExpressionCode() + table.GetExpressionCodeSize()),
+          names(table.GetNames().begin(), table.GetNames().end()) {
+        // Duplicates in the settings file are kept, so bindings selecting its layouts by index
+        // keep working
+        for (std::size_t i = 0; i < layouts.size(); ++i) {
+            key.clear();
+            AppendLayoutKey(layouts[i], expression_code.data(), key);
+            hashes.emplace(Hash(key), static_cast<u32>(i));
+        }
+    }
+
+    /// Returns false if an identical layout was already added.
+    bool Add(const Pack& pack, const CustomLayout& layout) {
+        key.clear();
+        const u32* code_end = AppendLayoutKey(layout, pack.expression_code.data(), key);
+        const u64 hash = Hash(key);
+        const auto range = hashes.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            other_key.clear();
+            AppendLayoutKey(layouts[it->second], expression_code.data(), other_key);
+            if (other_key == key) {
+                return false;
+            }
+        }
+
+        CustomLayout added = layout;
+        if (layout.expression_mask != 0) {
+            added.expression_code = static_cast<u32>(expression_code.size());
+            expression_code.insert(expression_code.end(),
+                                   pack.expression_code.data() + layout.expression_code,
+                                   code_end);
+        }
+        added.name_offset = static_cast<u32>(names.size());
+        names.insert(names.end(), pack.names.begin() + layout.name_offset,
+                     pack.names.begin() + layout.name_offset + layout.name_length);
+        hashes.emplace(hash, static_cast<u32>(layouts.size()));
+        layouts.push_back(added);
+        return true;
+    }
+
+    std::vector<CustomLayout> layouts;
+    std::vector<u32> expression_code;
+    std::vector<char> names;
+
+private:
+    std::unordered_multimap<u64, u32> hashes;
+    std::vector<u32> key;
+    std::vector<u32> other_key;
+};
+
+} // Anonymous namespace
+
+void LoadLayoutPacks(const std::string& settings_path, Settings& settings) {
+    settings.layout_pack_reports.clear();
+    if (settings.layout_packs.empty()) {
+        return;
+    }
+
+    std::vector<Pack> packs;
+    for (std::string& path : GetPackPaths(settings_path, settings.layout_packs)) {
+        packs.emplace_back();
+        packs.back().path = std::move(path);
+    }
+    ParsePacks(packs);
+
+    Merger merger(settings.layouts);
+    for (Pack& pack : packs) {
+        LayoutPackReport report;
+        report.parse_ns = pack.parse_ns;
+        if (pack.error.empty()) {
+            report.layout_count = static_cast<u32>(pack.layouts.size());
+            for (const CustomLayout& layout : pack.layouts) {
+                if (!merger.Add(pack, layout)) {
+                    ++report.duplicate_count;
+                }
+            }
+        }
+        report.path = std::move(pack.path);
+        report.error = std::move(pack.error);
+        settings.layout_pack_reports.push_back(std::move(report));
+    }
+    settings.layouts.Assign(std::move(merger.layouts), std::move(merger.expression_code),
+                            std::move(merger.names));
+}
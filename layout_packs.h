@@ -0,0 +1,19 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "settings.h"
+
+/**
+ * Adds the layouts of settings.layout_packs after the layouts read from the settings file at
+ * settings_path, and describes every pack in settings.layout_pack_reports.
+ * Packs are parsed in parallel on up to 4 threads, then added in the order they are listed in,
+ * the packs of a folder being its .json files in name order. A pack layout that looks the same as
+ * an earlier layout, whatever its name, is dropped, so layouts only depend on the order of the
+ * packs. Packs that can't be read are skipped.
+ */
+void LoadLayoutPacks(const std::string& settings_path, Settings& settings);
@@ -0,0 +1,116 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "host.h"
+#include "layout_picker.h"
+#include "layout_program.h"
+
+constexpr std::size_t PAGE_SIZE = LayoutPicker::PAGE_SIZE;
+
+// Goes back to the first page if page is past the end, after the layouts changed
+static std::size_t ClampPage(std::size_t page, std::size_t count) {
+    return page * PAGE_SIZE < count ? page : 0;
+}
+
+// Draws the items that change page, noun telling what's paged
+static void DrawPageItems(std::size_t& page, std::size_t count, const char* noun,
+                          LayoutPicker::MenuItemFunction menu_item) {
+    const std::size_t page_count = (count + PAGE_SIZE - 1) / PAGE_SIZE;
+    char label[64];
+    if (page > 0) {
+        std::snprintf(label, sizeof(label), "Previous %s (%zu of %zu)", noun, page, page_count);
+        if (menu_item(label)) {
+            --page;
+        }
+    }
+    if (page + 1 < page_count) {
+        std::snprintf(label, sizeof(label), "Next %s (%zu of %zu)", noun, page + 2, page_count);
+        if (menu_item(label)) {
+            ++page;
+        }
+    }
+}
+
+static bool DrawLayout(const LayoutPrograms& layouts, std::size_t index, u64 current_layout,
+                       LayoutPicker::MenuItemFunction menu_item) {
+    if (index != current_layout) {
+        return menu_item(layouts.GetLabel(index));
+    }
+    char label[256];
+    std::snprintf(label, sizeof(label), "%s (current)", layouts.GetLabel(index));
+    return menu_item(label);
+}
+
+std::size_t LayoutPicker::Draw(const LayoutPrograms& layouts, u64 current_layout,
+                               MenuItemFunction menu_item) {
+    if (layouts.empty() || !vvctre_gui_begin_menu("Layouts")) {
+        open = false;
+        return NONE;
+    }
+    if (!open) {
+        open = true;
+        page = current_layout < layouts.size() ? current_layout / PAGE_SIZE : 0;
+    }
+
+    std::size_t clicked = NONE;
+    page = ClampPage(page, layouts.size());
+    const std::size_t end = std::min(layouts.size(), (page + 1) * PAGE_SIZE);
+    for (std::size_t i = page * PAGE_SIZE; i < end; ++i) {
+        if (DrawLayout(layouts, i, current_layout, menu_item)) {
+            clicked = i;
+        }
+    }
+    DrawPageItems(page, layouts.size(), "page", menu_item);
+
+    if (layouts.GetInitialCount() != 0 && vvctre_gui_begin_menu("By name")) {
+        const std::size_t clicked_by_name = DrawByName(layouts, current_layout, menu_item);
+        if (clicked_by_name != NONE) {
+            clicked = clicked_by_name;
+        }
+        vvctre_gui_end_menu();
+    }
+
+    vvctre_gui_end_menu();
+    return clicked;
+}
+
+std::size_t LayoutPicker::DrawByName(const LayoutPrograms& layouts, u64 current_layout,
+                                     MenuItemFunction menu_item) {
+    std::size_t clicked = NONE;
+    const std::size_t initial_count = layouts.GetInitialCount();
+    initials_page = ClampPage(initials_page, initial_count);
+    const std::size_t initials_end = std::min(initial_count, (initials_page + 1) * PAGE_SIZE);
+    for (std::size_t i = initials_page * PAGE_SIZE; i < initials_end; ++i) {
+        const std::string_view initial = layouts.GetInitial(i);
+        char label[8];
+        std::memcpy(label, initial.data(), initial.size());
+        label[initial.size()] = '\0';
+        if (!vvctre_gui_begin_menu(label)) {
+            continue;
+        }
+
+        if (i != open_initial) {
+            open_initial = i;
+            initial_page = 0;
+        }
+        const auto [begin, end] = layouts.GetInitialRange(i);
+        initial_page = ClampPage(initial_page, end - begin);
+        const std::size_t page_end = std::min(end, begin + (initial_page + 1) * PAGE_SIZE);
+        for (std::size_t position = begin + initial_page * PAGE_SIZE; position < page_end;
+             ++position) {
+            const std::size_t index = layouts.GetNameIndexEntry(position);
+            if (DrawLayout(layouts, index, current_layout, menu_item)) {
+                clicked = index;
+            }
+        }
+        DrawPageItems(initial_page, end - begin, "page", menu_item);
+        vvctre_gui_end_menu();
+    }
+    DrawPageItems(initials_page, initial_count, "characters", menu_item);
+    return clicked;
+}
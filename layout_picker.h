@@ -0,0 +1,38 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common_types.h"
+
+class LayoutPrograms;
+
+/**
+ * The Layouts menu. It lists one page of layouts at a time, starting at the current one, and has a
+ * By name menu with a submenu per first character of the layout names. Labels come from
+ * LayoutPrograms, so a frame costs the same whatever the number of layouts.
+ */
+class LayoutPicker {
+public:
+    static constexpr std::size_t PAGE_SIZE = 25;
+    static constexpr std::size_t NONE = static_cast<std::size_t>(-1);
+
+    typedef bool (*MenuItemFunction)(const char* label);
+
+    /// Draws the menu with menu_item for the items. Returns the clicked layout, or NONE.
+    std::size_t Draw(const LayoutPrograms& layouts, u64 current_layout, MenuItemFunction menu_item);
+
+private:
+    std::size_t DrawByName(const LayoutPrograms& layouts, u64 current_layout,
+                           MenuItemFunction menu_item);
+
+    bool open = false;
+    std::size_t page = 0;
+    std::size_t initials_page = 0;
+    /// The initial whose submenu was open last, and its page
+    std::size_t open_initial = NONE;
+    std::size_t initial_page = 0;
+};
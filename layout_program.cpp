@@ -0,0 +1,151 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstdio>
+
+#include "layout_program.h"
+#include "settings.h"
+
+// Returns the length of the UTF-8 character name starts with, name must not be empty
+static std::size_t GetFirstCharacterLength(std::string_view name) {
+    const u8 lead = static_cast<u8>(name[0]);
+    const std::size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    return std::min(length, name.size());
+}
+
+void LayoutPrograms::Emit(LayoutCommand command, s32 first_argument, s32 second_argument) {
+    commands.push_back(command);
+    first_arguments.push_back(first_argument);
+    second_arguments.push_back(second_argument);
+}
+
+void LayoutPrograms::Compile(const LayoutTable& layouts, const WindowSize& window_size) {
+    // Most layouts have the 8 screen commands and one window command
+    const std::size_t expected_size = layouts.size() * 9;
+    commands.clear();
+    commands.reserve(expected_size);
+    first_arguments.clear();
+    first_arguments.reserve(expected_size);
+    second_arguments.clear();
+    second_arguments.reserve(expected_size);
+    offsets.assign(1, 0);
+    offsets.reserve(layouts.size() + 1);
+    settings_sizes.clear();
+    settings_sizes.reserve(layouts.size());
+    names.assign(layouts.GetNames().begin(), layouts.GetNames().end());
+    name_offsets.assign(1, 0);
+    name_offsets.reserve(layouts.size() + 1);
+
+    for (std::size_t i = 0; i < layouts.size(); ++i) {
+        const CustomLayout layout = layouts.Resolve(i, window_size);
+
+        if (layout.upright) {
+            Emit(LayoutCommand::SetUprightScreens, *layout.upright ? 1 : 0);
+        }
+        Emit(LayoutCommand::SetTopLeft, layout.top_screen.left);
+        Emit(LayoutCommand::SetTopTop, layout.top_screen.top);
+        Emit(LayoutCommand::SetTopRight, layout.top_screen.right);
+        Emit(LayoutCommand::SetTopBottom, layout.top_screen.bottom);
+        Emit(LayoutCommand::SetBottomLeft, layout.bottom_screen.left);
+        Emit(LayoutCommand::SetBottomTop, layout.bottom_screen.top);
+        Emit(LayoutCommand::SetBottomRight, layout.bottom_screen.right);
+        Emit(LayoutCommand::SetBottomBottom, layout.bottom_screen.bottom);
+        settings_sizes.push_back(static_cast<u8>(commands.size() - offsets.back()));
+
+        if (layout.resize_window.enabled) {
+            Emit(LayoutCommand::SetWindowSize, layout.resize_window.width,
+                 layout.resize_window.height);
+        }
+        if (layout.move_window.enabled) {
+            Emit(LayoutCommand::SetWindowPosition, layout.move_window.x, layout.move_window.y);
+        }
+        offsets.push_back(static_cast<u32>(commands.size()));
+        // The table's names are stored in layout order, so one offset per layout is enough
+        name_offsets.push_back(layout.name_offset + layout.name_length);
+    }
+
+    IndexNames();
+}
+
+void LayoutPrograms::IndexNames() {
+    labels.clear();
+    label_offsets.clear();
+    label_offsets.reserve(size());
+    name_index.clear();
+
+    char prefix[32];
+    for (std::size_t i = 0; i < size(); ++i) {
+        const std::string_view name = GetName(i);
+        const int length =
+            std::snprintf(prefix, sizeof(prefix), name.empty() ? "Layout %zu" : "%zu: ", i);
+        label_offsets.push_back(static_cast<u32>(labels.size()));
+        labels.insert(labels.end(), prefix, prefix + length);
+        labels.insert(labels.end(), name.begin(), name.end());
+        labels.push_back('\0');
+
+        if (!name.empty()) {
+            name_index.push_back(static_cast<u32>(i));
+        }
+    }
+
+    std::sort(name_index.begin(), name_index.end(), [this](u32 a, u32 b) {
+        const int order = GetName(a).compare(GetName(b));
+        return order < 0 || (order == 0 && a < b);
+    });
+
+    initial_starts.clear();
+    std::string_view previous_initial;
+    for (std::size_t i = 0; i < name_index.size(); ++i) {
+        const std::string_view name = GetName(name_index[i]);
+        const std::string_view initial = name.substr(0, GetFirstCharacterLength(name));
+        if (i == 0 || initial != previous_initial) {
+            initial_starts.push_back(static_cast<u32>(i));
+            previous_initial = initial;
+        }
+    }
+    if (!initial_starts.empty()) {
+        initial_starts.push_back(static_cast<u32>(name_index.size()));
+    }
+}
+
+std::size_t LayoutPrograms::GetMemoryUsage() const {
+    return commands.capacity() * sizeof(LayoutCommand) +
+           first_arguments.capacity() * sizeof(s32) + second_arguments.capacity() * sizeof(s32) +
+           offsets.capacity() * sizeof(u32) + settings_sizes.capacity() * sizeof(u8) +
+           names.capacity() + name_offsets.capacity() * sizeof(u32) + labels.capacity() +
+           label_offsets.capacity() * sizeof(u32) + name_index.capacity() * sizeof(u32) +
+           initial_starts.capacity() * sizeof(u32);
+}
+
+// Compares a name index entry with a name, for binary searches of the name index
+static auto NameIsBefore(const LayoutPrograms& programs) {
+    return [&programs](u32 index, std::string_view name) { return programs.GetName(index) < name; };
+}
+
+std::size_t LayoutPrograms::FindByName(std::string_view name) const {
+    // Equal names are sorted by index, so this is the first layout with the name
+    const auto found =
+        std::lower_bound(name_index.begin(), name_index.end(), name, NameIsBefore(*this));
+    return found != name_index.end() && GetName(*found) == name ? *found : size();
+}
+
+std::string_view LayoutPrograms::GetInitial(std::size_t group) const {
+    const std::string_view name = GetName(name_index[initial_starts[group]]);
+    return name.substr(0, GetFirstCharacterLength(name));
+}
+
+void LayoutPrograms::swap(LayoutPrograms& other) noexcept {
+    commands.swap(other.commands);
+    first_arguments.swap(other.first_arguments);
+    second_arguments.swap(other.second_arguments);
+    offsets.swap(other.offsets);
+    settings_sizes.swap(other.settings_sizes);
+    names.swap(other.names);
+    name_offsets.swap(other.name_offsets);
+    labels.swap(other.labels);
+    label_offsets.swap(other.label_offsets);
+    name_index.swap(other.name_index);
+    initial_starts.swap(other.initial_starts);
+}
@@ -0,0 +1,121 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common_types.h"
+
+class LayoutTable;
+struct WindowSize;
+
+/// A host call made by a layout program
+enum class LayoutCommand : u8 {
+    SetUprightScreens,
+    SetTopLeft,
+    SetTopTop,
+    SetTopRight,
+    SetTopBottom,
+    SetBottomLeft,
+    SetBottomTop,
+    SetBottomRight,
+    SetBottomBottom,
+    // The commands below aren't settings, vvctre_settings_apply isn't needed after them
+    SetWindowSize,
+    SetWindowPosition,
+    Count,
+};
+
+constexpr std::size_t LAYOUT_COMMAND_COUNT = static_cast<std::size_t>(LayoutCommand::Count);
+
+/**
+ * Every layout compiled into the host calls it needs, in order, with their arguments.
+ * The commands of all layouts are stored back to back in parallel arrays, and a layout is a range
+ * of them.
+ */
+class LayoutPrograms {
+public:
+    /// The commands of one layout. The first settings_size commands change settings.
+    struct Program {
+        const LayoutCommand* commands;
+        const s32* first_arguments;
+        const s32* second_arguments;
+        u32 size;
+        u32 settings_size;
+    };
+
+    /// Compiles every layout of layouts, evaluating their expressions for window_size.
+    void Compile(const LayoutTable& layouts, const WindowSize& window_size);
+    void swap(LayoutPrograms& other) noexcept;
+
+    Program operator[](std::size_t index) const {
+        const u32 begin = offsets[index];
+        return Program{commands.data() + begin, first_arguments.data() + begin,
+                       second_arguments.data() + begin, offsets[index + 1] - begin,
+                       settings_sizes[index]};
+    }
+    std::size_t size() const {
+        return settings_sizes.size();
+    }
+    bool empty() const {
+        return settings_sizes.empty();
+    }
+
+    /// Empty if the layout has no name.
+    std::string_view GetName(std::size_t index) const {
+        return std::string_view(names.data() + name_offsets[index],
+                                name_offsets[index + 1] - name_offsets[index]);
+    }
+
+    /// Returns the index of the first layout named name, or size() if there's none.
+    std::size_t FindByName(std::string_view name) const;
+
+    /// "index: name", or "Layout index" if the layout has no name
+    const char* GetLabel(std::size_t index) const {
+        return labels.data() + label_offsets[index];
+    }
+
+    /// The layouts with a name, sorted by name then by index
+    u32 GetNameIndexEntry(std::size_t position) const {
+        return name_index[position];
+    }
+
+    /// The name index is split in groups of names starting with the same UTF-8 character.
+    std::size_t GetInitialCount() const {
+        return initial_starts.empty() ? 0 : initial_starts.size() - 1;
+    }
+    std::string_view GetInitial(std::size_t group) const;
+    std::pair<std::size_t, std::size_t> GetInitialRange(std::size_t group) const {
+        return {initial_starts[group], initial_starts[group + 1]};
+    }
+
+    /// Returns the bytes allocated for the programs.
+    std::size_t GetMemoryUsage() const;
+
+private:
+    void Emit(LayoutCommand command, s32 first_argument, s32 second_argument = 0);
+    void IndexNames();
+
+    std::vector<LayoutCommand> commands;
+    std::vector<s32> first_arguments;
+    std::vector<s32> second_arguments;
+    /// Where the commands of each layout start, followed by the end of the last one
+    std::vector<u32> offsets;
+    std::vector<u8> settings_sizes;
+
+    std::vector<char> names;
+    /// Where the name of each layout starts, followed by the end of the last one
+    std::vector<u32> name_offsets;
+
+    /// The labels of every layout back to back, each followed by a 0, so menus never format them
+    std::vector<char> labels;
+    std::vector<u32> label_offsets;
+    std::vector<u32> name_index;
+    /// Where each group of the name index starts, followed by the size of the name index
+    std::vector<u32> initial_starts;
+};
@@ -0,0 +1,120 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cmath>
+
+#include "instrumentation.h"
+#include "layout_applier.h"
+#include "layout_transition.h"
+
+static bool IsAnimated(LayoutCommand command) {
+    return (command >= LayoutCommand::SetTopLeft && command <= LayoutCommand::SetBottomBottom) ||
+           command == LayoutCommand::SetWindowSize;
+}
+
+void LayoutTransition::Configure(const TransitionSettings& settings_) {
+    settings = settings_;
+    running = false;
+}
+
+double LayoutTransition::Ease(double t) const {
+    switch (settings.easing) {
+    case TransitionSettings::Easing::Linear:
+        return t;
+    case TransitionSettings::Easing::EaseIn:
+        return t * t * t;
+    case TransitionSettings::Easing::EaseOut:
+        return 1.0 - (1.0 - t) * (1.0 - t) * (1.0 - t);
+    case TransitionSettings::Easing::EaseInOut:
+        return t < 0.5 ? 4.0 * t * t * t : 1.0 - 4.0 * (1.0 - t) * (1.0 - t) * (1.0 - t);
+    }
+    return t;
+}
+
+void LayoutTransition::Start(LayoutApplier& applier, const LayoutPrograms::Program& program) {
+    running = false;
+    animated_mask = 0;
+
+    // Starting from the values last pushed also continues a transition that was cut short
+    if (applier.IsCustomLayoutEnabled()) {
+        for (u32 i = 0; i < program.size; ++i) {
+            const LayoutCommand command = program.commands[i];
+            const std::size_t index = static_cast<std::size_t>(command);
+            if (IsAnimated(command) &&
+                applier.GetLastArguments(command, from_first_arguments[index],
+                                         from_second_arguments[index]) &&
+                (from_first_arguments[index] != program.first_arguments[i] ||
+                 from_second_arguments[index] != program.second_arguments[i])) {
+                to_first_arguments[index] = program.first_arguments[i];
+                to_second_arguments[index] = program.second_arguments[i];
+                animated_mask |= 1u << index;
+            }
+        }
+    }
+    if (animated_mask == 0) {
+        applier.Apply(program, true);
+        return;
+    }
+
+    std::copy(program.commands, program.commands + program.size, target_commands);
+    std::copy(program.first_arguments, program.first_arguments + program.size,
+              target_first_arguments);
+    std::copy(program.second_arguments, program.second_arguments + program.size,
+              target_second_arguments);
+    target_size = program.size;
+    target_settings_size = program.settings_size;
+
+    running = true;
+    frame = 0;
+    advance = 1;
+    RunStep(applier);
+}
+
+void LayoutTransition::RunStep(LayoutApplier& applier) {
+    Instrumentation::ScopedTimer timer(Instrumentation::Metric::TransitionStep);
+
+    frame += advance;
+    if (frame >= settings.frames) {
+        running = false;
+        applier.Apply(LayoutPrograms::Program{target_commands, target_first_arguments,
+                                              target_second_arguments, target_size,
+                                              target_settings_size},
+                      true);
+        return;
+    }
+
+    const double t = Ease(static_cast<double>(frame) / settings.frames);
+    const auto interpolate = [t](s32 from, s32 to) {
+        return static_cast<s32>(std::lround(from + (static_cast<double>(to) - from) * t));
+    };
+
+    // Settings first, then the window size, like in a compiled program
+    LayoutCommand commands[LAYOUT_COMMAND_COUNT];
+    s32 first_arguments[LAYOUT_COMMAND_COUNT];
+    s32 second_arguments[LAYOUT_COMMAND_COUNT];
+    u32 size = 0;
+    u32 settings_size = 0;
+    for (std::size_t i = 0; i < LAYOUT_COMMAND_COUNT; ++i) {
+        if ((animated_mask & (1u << i)) == 0) {
+            continue;
+        }
+        commands[size] = static_cast<LayoutCommand>(i);
+        first_arguments[size] = interpolate(from_first_arguments[i], to_first_arguments[i]);
+        second_arguments[size] = interpolate(from_second_arguments[i], to_second_arguments[i]);
+        ++size;
+        if (static_cast<LayoutCommand>(i) < LayoutCommand::SetWindowSize) {
+            settings_size = size;
+        }
+    }
+
+    const u64 start = settings.frame_budget_us != 0 ? Instrumentation::Now() : 0;
+    applier.Apply(LayoutPrograms::Program{commands, first_arguments, second_arguments, size,
+                                          settings_size},
+                  true);
+    if (settings.frame_budget_us != 0) {
+        const u64 budget = static_cast<u64>(settings.frame_budget_us) * 1000;
+        advance = static_cast<u32>(std::max<u64>(1, (Instrumentation::Now() - start) / budget));
+    }
+}
@@ -0,0 +1,73 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common_types.h"
+#include "layout_program.h"
+#include "settings.h"
+
+class LayoutApplier;
+
+/**
+ * Animates switches over several frames.
+ * The screen rectangles and the window size move from what was last pushed to the target layout
+ * with easing, one step per frame. When a step takes longer than the frame budget, the following
+ * steps are skipped in proportion, so a slow host finishes in about the same time with fewer
+ * reconfigurations. The last step pushes the whole target layout, including upright and the
+ * window position.
+ */
+class LayoutTransition {
+public:
+    void Configure(const TransitionSettings& settings);
+
+    bool IsEnabled() const {
+        return settings.frames > 1;
+    }
+
+    /**
+     * Replaces the running transition with one to program and pushes its first step.
+     * Pushes program right away if there's nothing to animate from.
+     */
+    void Start(LayoutApplier& applier, const LayoutPrograms::Program& program);
+
+    /// Pushes the next step, called every frame before anything can start a transition.
+    void Step(LayoutApplier& applier) {
+        if (running) {
+            RunStep(applier);
+        }
+    }
+
+    void Cancel() {
+        running = false;
+    }
+
+    bool IsRunning() const {
+        return running;
+    }
+
+private:
+    void RunStep(LayoutApplier& applier);
+    double Ease(double t) const;
+
+    TransitionSettings settings;
+    bool running = false;
+    u32 frame = 0;
+    /// Frames the next step moves forward by
+    u32 advance = 1;
+
+    // A copy of the target program, layouts can be reloaded during the transition
+    LayoutCommand target_commands[LAYOUT_COMMAND_COUNT];
+    s32 target_first_arguments[LAYOUT_COMMAND_COUNT];
+    s32 target_second_arguments[LAYOUT_COMMAND_COUNT];
+    u32 target_size = 0;
+    u32 target_settings_size = 0;
+
+    // Indexed by LayoutCommand
+    u32 animated_mask = 0;
+    s32 from_first_arguments[LAYOUT_COMMAND_COUNT];
+    s32 from_second_arguments[LAYOUT_COMMAND_COUNT];
+    s32 to_first_arguments[LAYOUT_COMMAND_COUNT];
+    s32 to_second_arguments[LAYOUT_COMMAND_COUNT];
+};
@@ -0,0 +1,142 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "live_state.h"
+#include "string_util.h"
+
+namespace LiveState {
+
+Publisher::~Publisher() {
+    Close();
+}
+
+bool Publisher::Open(const std::string& path_) {
+    Close();
+
+#ifdef _WIN32
+    // Readers open the file while it's open here
+    const HANDLE file = CreateFileW(Common::UTF8ToUTF16W(path_).c_str(),
+                                    GENERIC_READ | GENERIC_WRITE,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    // Grows the file to the size of the mapping
+    const HANDLE mapping =
+        CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, sizeof(Shared), nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(Shared));
+    CloseHandle(mapping);
+    if (view == nullptr) {
+        return false;
+    }
+#else
+    const int fd = open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    if (ftruncate(fd, sizeof(Shared)) != 0) {
+        close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+#endif
+
+    path = path_;
+    shared = static_cast<Shared*>(view);
+    published = false;
+    // A previous writer may have stopped in the middle of a write
+    const u32 sequence = shared->sequence.load(std::memory_order_relaxed);
+    shared->sequence.store(sequence + (sequence & 1), std::memory_order_relaxed);
+    return true;
+}
+
+void Publisher::Close() {
+    if (shared == nullptr) {
+        return;
+    }
+    const u32 sequence = shared->sequence.load(std::memory_order_relaxed);
+    shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    shared->layout.store(NO_LAYOUT, std::memory_order_relaxed);
+    shared->flags.store(0, std::memory_order_relaxed);
+    shared->sequence.store(sequence + 2, std::memory_order_release);
+
+#ifdef _WIN32
+    UnmapViewOfFile(shared);
+#else
+    munmap(shared, sizeof(Shared));
+#endif
+    shared = nullptr;
+    path.clear();
+}
+
+void Publisher::Publish(const LayoutApplier& applier, u32 layout, bool switching) {
+    u32 flags = 0;
+    if (applier.IsCustomLayoutEnabled()) {
+        flags |= CustomLayoutEnabled;
+    }
+    if (switching) {
+        flags |= Switching;
+    }
+    s32 first;
+    s32 second;
+    if (applier.GetLastArguments(LayoutCommand::SetUprightScreens, first, second) && first != 0) {
+        flags |= Upright;
+    }
+
+    // Rectangles that were never pushed are 0
+    u32 screens[8] = {};
+    for (std::size_t i = 0; i < 8; ++i) {
+        const LayoutCommand command = static_cast<LayoutCommand>(
+            static_cast<std::size_t>(LayoutCommand::SetTopLeft) + i);
+        if (applier.GetLastArguments(command, first, second)) {
+            screens[i] = static_cast<u32>(first);
+        }
+    }
+    s32 window[4] = {};
+    if (applier.GetLastArguments(LayoutCommand::SetWindowSize, window[0], window[1])) {
+        flags |= WindowSizeKnown;
+    }
+    if (applier.GetLastArguments(LayoutCommand::SetWindowPosition, window[2], window[3])) {
+        flags |= WindowPositionKnown;
+    }
+
+    const u32 sequence = shared->sequence.load(std::memory_order_relaxed);
+    shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    shared->magic.store(MAGIC, std::memory_order_relaxed);
+    shared->version.store(VERSION, std::memory_order_relaxed);
+    shared->layout.store(layout, std::memory_order_relaxed);
+    shared->flags.store(flags, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < 4; ++i) {
+        shared->top_screen[i].store(screens[i], std::memory_order_relaxed);
+        shared->bottom_screen[i].store(screens[4 + i], std::memory_order_relaxed);
+        shared->window[i].store(window[i], std::memory_order_relaxed);
+    }
+    shared->sequence.store(sequence + 2, std::memory_order_release);
+
+    published = true;
+    published_change_count = applier.GetChangeCount();
+    published_layout = layout;
+    published_switching = switching;
+}
+
+} // namespace LiveState
@@ -0,0 +1,134 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "common_types.h"
+#include "layout_applier.h"
+
+/**
+ * The layout vvctre shows, published in a small memory-mapped file for capture and overlay tools.
+ * The file is a Shared, 68 bytes of little-endian 32-bit words:
+ *   0 magic, 4 version, 8 sequence, 12 layout, 16 flags,
+ *   20 top screen left, top, right, bottom, 36 bottom screen left, top, right, bottom,
+ *   52 window width, height, x, y
+ * It's written under a seqlock: the sequence is odd while the words are being written. A reader
+ * reads the sequence, the words, then the sequence again, and keeps the words if both sequences
+ * are the same even number. The writer never waits for readers.
+ */
+namespace LiveState {
+
+constexpr u32 MAGIC = 0x534C4343; // CCLS
+constexpr u32 VERSION = 1;
+/// layout when no layout was selected yet, or the plugin stopped publishing
+constexpr u32 NO_LAYOUT = 0xFFFFFFFF;
+
+enum Flag : u32 {
+    /// vvctre uses the custom layout, the rectangles are meaningless without it
+    CustomLayoutEnabled = 1 << 0,
+    Upright = 1 << 1,
+    /// The rectangles and window aren't the ones of layout yet, because switches are being
+    /// coalesced or a transition is running
+    Switching = 1 << 2,
+    /// The window values are the last ones a layout pushed. Otherwise no layout resized or moved
+    /// the window.
+    WindowSizeKnown = 1 << 3,
+    WindowPositionKnown = 1 << 4,
+};
+
+struct Shared {
+    std::atomic<u32> magic;
+    std::atomic<u32> version;
+    std::atomic<u32> sequence;
+    std::atomic<u32> layout;
+    std::atomic<u32> flags;
+    std::atomic<u32> top_screen[4];
+    std::atomic<u32> bottom_screen[4];
+    std::atomic<s32> window[4];
+};
+
+// Other processes map the file, so the atomics must be plain words
+static_assert(std::atomic<u32>::is_always_lock_free && std::atomic<s32>::is_always_lock_free);
+static_assert(sizeof(Shared) == 68);
+
+struct Snapshot {
+    u32 sequence;
+    u32 layout;
+    u32 flags;
+    /// left, top, right, bottom
+    u32 top_screen[4];
+    u32 bottom_screen[4];
+    /// width, height, x, y
+    s32 window[4];
+};
+
+/// Copies a consistent state. Returns false, without waiting, if the writer was writing, or if
+/// the file was never written.
+inline bool TryRead(const Shared& shared, Snapshot& snapshot) {
+    const u32 sequence = shared.sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0 || shared.magic.load(std::memory_order_relaxed) != MAGIC ||
+        shared.version.load(std::memory_order_relaxed) != VERSION) {
+        return false;
+    }
+    snapshot.sequence = sequence;
+    snapshot.layout = shared.layout.load(std::memory_order_relaxed);
+    snapshot.flags = shared.flags.load(std::memory_order_relaxed);
+    for (int i = 0; i < 4; ++i) {
+        snapshot.top_screen[i] = shared.top_screen[i].load(std::memory_order_relaxed);
+        snapshot.bottom_screen[i] = shared.bottom_screen[i].load(std::memory_order_relaxed);
+        snapshot.window[i] = shared.window[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return shared.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+/// Maps the file and writes it when the pushed layout changes.
+class Publisher {
+public:
+    Publisher() = default;
+    Publisher(const Publisher&) = delete;
+    Publisher& operator=(const Publisher&) = delete;
+    ~Publisher();
+
+    /// Creates or reuses the file at path. Returns false if it can't be mapped.
+    bool Open(const std::string& path);
+    /// Publishes NO_LAYOUT and unmaps the file, which is left for readers that still map it.
+    void Close();
+
+    bool IsOpen() const {
+        return shared != nullptr;
+    }
+    const std::string& GetPath() const {
+        return path;
+    }
+
+    /**
+     * Publishes what applier last pushed if it pushed something, layout changed, or the switch
+     * ended since the last call. Only a few comparisons otherwise.
+     */
+    void Update(const LayoutApplier& applier, u64 layout, bool switching) {
+        const u32 index = layout > NO_LAYOUT ? NO_LAYOUT : static_cast<u32>(layout);
+        if (shared != nullptr &&
+            (!published || applier.GetChangeCount() != published_change_count ||
+             index != published_layout || switching != published_switching)) {
+            Publish(applier, index, switching);
+        }
+    }
+
+private:
+    void Publish(const LayoutApplier& applier, u32 layout, bool switching);
+
+    std::string path;
+    Shared* shared = nullptr;
+
+    bool published = false;
+    u32 published_change_count = 0;
+    u32 published_layout = NO_LAYOUT;
+    bool published_switching = false;
+};
+
+} // namespace LiveState
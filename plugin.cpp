@@ -2,17 +2,28 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
-#include <fstream>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
-#include <sstream>
-#include <vector>
-#include <optional>
-
-#include <nlohmann/json.hpp>
-#include <whereami.h>
+#include <string>
+#include <string_view>
 
 #include "common_types.h"
-#include "string_util.h"
+#include "control_server.h"
+#include "host.h"
+#include "input.h"
+#include "input_trace.h"
+#include "instrumentation.h"
+#include "layout_applier.h"
+#include "layout_picker.h"
+#include "layout_transition.h"
+#include "live_state.h"
+#include "profile_loader.h"
+#include "profiles.h"
+#include "settings.h"
+#include "settings_prefetcher.h"
+#include "settings_watcher.h"
+#include "switch_coalescer.h"
 
 #ifdef _WIN32
 #define VVCTRE_PLUGIN_EXPORT extern "C" __declspec(dllexport)
@@ -20,100 +31,316 @@
 #define VVCTRE_PLUGIN_EXPORT extern "C"
 #endif
 
-static const char* required_function_names[] = {
-    "vvctre_settings_set_custom_layout_top_left",
-    "vvctre_settings_set_custom_layout_top_top",
-    "vvctre_settings_set_custom_layout_top_right",
-    "vvctre_settings_set_custom_layout_top_bottom",
-    "vvctre_settings_set_custom_layout_bottom_left",
-    "vvctre_settings_set_custom_layout_bottom_top",
-    "vvctre_settings_set_custom_layout_bottom_right",
-    "vvctre_settings_set_custom_layout_bottom_bottom",
-    "vvctre_button_device_new",
-    "vvctre_button_device_get_state",
-    "vvctre_settings_apply",
-    "vvctre_settings_set_use_custom_layout",
-    "vvctre_set_os_window_size",
-    "vvctre_set_os_window_position",
-    "vvctre_settings_set_upright_screens",
-    "vvctre_gui_begin_menu",
-    "vvctre_gui_end_menu",
-    "vvctre_gui_menu_item",
-    "vvctre_button_device_delete",
-};
-
-typedef void (*vvctre_settings_set_custom_layout_top_left_t)(u16 value);
-typedef void (*vvctre_settings_set_custom_layout_top_top_t)(u16 value);
-typedef void (*vvctre_settings_set_custom_layout_top_right_t)(u16 value);
-typedef void (*vvctre_settings_set_custom_layout_top_bottom_t)(u16 value);
-typedef void (*vvctre_settings_set_custom_layout_bottom_left_t)(u16 value);
-typedef void (*vvctre_settings_set_custom_layout_bottom_top_t)(u16 value);
-typedef void (*vvctre_settings_set_custom_layout_bottom_right_t)(u16 value);
-typedef void (*vvctre_settings_set_custom_layout_bottom_bottom_t)(u16 value);
-typedef void* (*vvctre_button_device_new_t)(void* plugin_manager, const char* params);
-typedef bool (*vvctre_button_device_get_state_t)(void* device);
-typedef void (*vvctre_settings_apply_t)();
-typedef void (*vvctre_settings_set_use_custom_layout_t)(bool value);
-typedef void (*vvctre_set_os_window_size_t)(void* plugin_manager, int width, int height);
-typedef void (*vvctre_set_os_window_position_t)(void* plugin_manager, int x, int y);
-typedef void (*vvctre_settings_set_upright_screens_t)(bool value);
-typedef bool (*vvctre_gui_begin_menu_t)(const char* label);
-typedef void (*vvctre_gui_end_menu_t)();
-typedef bool (*vvctre_gui_menu_item_t)(const char* label);
-typedef void (*vvctre_button_device_delete_t)(void* plugin_manager, void* device);
-
-static vvctre_settings_set_custom_layout_top_left_t vvctre_settings_set_custom_layout_top_left;
-static vvctre_settings_set_custom_layout_top_top_t vvctre_settings_set_custom_layout_top_top;
-static vvctre_settings_set_custom_layout_top_right_t vvctre_settings_set_custom_layout_top_right;
-static vvctre_settings_set_custom_layout_top_bottom_t vvctre_settings_set_custom_layout_top_bottom;
-static vvctre_settings_set_custom_layout_bottom_left_t
-    vvctre_settings_set_custom_layout_bottom_left;
-static vvctre_settings_set_custom_layout_bottom_top_t vvctre_settings_set_custom_layout_bottom_top;
-static vvctre_settings_set_custom_layout_bottom_right_t
-    vvctre_settings_set_custom_layout_bottom_right;
-static vvctre_settings_set_custom_layout_bottom_bottom_t
-    vvctre_settings_set_custom_layout_bottom_bottom;
-static vvctre_button_device_new_t vvctre_button_device_new;
-static vvctre_button_device_get_state_t vvctre_button_device_get_state;
-static vvctre_settings_apply_t vvctre_settings_apply;
-static vvctre_settings_set_use_custom_layout_t vvctre_settings_set_use_custom_layout;
-static vvctre_set_os_window_size_t vvctre_set_os_window_size;
-static vvctre_set_os_window_position_t vvctre_set_os_window_position;
-static vvctre_settings_set_upright_screens_t vvctre_settings_set_upright_screens;
-static vvctre_gui_begin_menu_t vvctre_gui_begin_menu;
-static vvctre_gui_end_menu_t vvctre_gui_end_menu;
-static vvctre_gui_menu_item_t vvctre_gui_menu_item;
-static vvctre_button_device_delete_t vvctre_button_device_delete;
-
-static void* plugin_manager;
-static void* button = nullptr;
-static bool button_pressed = false;
+static InputEngine input_engine;
 static u64 current_custom_layout = -1;
 static bool load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time = true;
 
-struct CustomLayout {
-    std::optional<bool> upright;
-    struct Screen {
-        u16 left = 0;
-        u16 top = 0;
-        u16 right = 0;
-        u16 bottom = 0;
-    } top_screen, bottom_screen;
-    struct ResizeWindow {
-        bool enabled = false;
-        int width = 0;
-        int height = 0;
-    } resize_window;
-    struct MoveWindow {
-        bool enabled = false;
-        int x = 0;
-        int y = 0;
-    } move_window;
-};
-std::vector<CustomLayout> custom_layouts;
+static LayoutPrograms settings_file_layouts;
+// The settings file's layouts, or the active profile's
+static const LayoutPrograms* custom_layouts = &settings_file_layouts;
+static ProfileManager profile_manager;
+static ProfileLoader profile_loader;
+// Both looked up once in PluginLoaded
+static std::string vvctre_folder;
+static std::string settings_file_path;
+static SettingsPrefetcher settings_prefetcher;
+static SettingsWatcher settings_watcher;
+static LayoutApplier layout_applier;
+static SwitchCoalescer switch_coalescer;
+static LayoutTransition layout_transition;
+static ControlServer control_server;
+static InputTrace::Recorder input_trace;
+static LayoutPicker layout_picker;
+static LiveState::Publisher live_state;
+// The instrumentation is restarted only when these change, restarting truncates its output
+static InstrumentationSettings instrumentation_settings;
+
+static void PushCurrentLayout() {
+    Instrumentation::ScopedTimer timer(Instrumentation::Metric::Switch);
+    if (layout_transition.IsEnabled()) {
+        layout_transition.Start(layout_applier, (*custom_layouts)[current_custom_layout]);
+    } else {
+        layout_applier.Apply((*custom_layouts)[current_custom_layout], true);
+    }
+    Instrumentation::Increment(Instrumentation::Counter::Switches);
+}
+
+// Only changes current_custom_layout while switches are being coalesced
+static void SwitchToLayout(u64 index) {
+    current_custom_layout = index;
+    // vvctre's menu can have changed the layout since the last push
+    layout_applier.Reset();
+    if (switch_coalescer.OnSwitch()) {
+        PushCurrentLayout();
+    } else {
+        Instrumentation::Increment(Instrumentation::Counter::CoalescedSwitches);
+    }
+}
+
+// Only a few comparisons when nothing was pushed since the last call
+static void PublishLiveState() {
+    live_state.Update(layout_applier, current_custom_layout,
+                      switch_coalescer.IsPending() || layout_transition.IsRunning());
+}
+
+// The settings watcher reloads the active profile with the settings when its file changes
+static void WatchActiveProfile() {
+    ActiveProfile profile;
+    profile_manager.DescribeActive(profile);
+    settings_watcher.SetActiveProfile(profile);
+}
+
+// Makes the layouts of a loaded profile, or of the settings file for NO_PROFILE, the current
+// layouts, and pushes the first one
+static void UseProfile(std::size_t index) {
+    profile_manager.SetActive(index);
+    custom_layouts = index == ProfileManager::NO_PROFILE
+                         ? &settings_file_layouts
+                         : profile_manager.GetProfile(index).programs.get();
+    WatchActiveProfile();
+
+    switch_coalescer.Cancel();
+    if (custom_layouts->empty()) {
+        current_custom_layout = -1;
+    } else {
+        current_custom_layout = 0;
+        layout_applier.Reset();
+        PushCurrentLayout();
+    }
+}
+
+// Selects the profile named name, or the settings file's layouts if name is empty. Profiles are
+// loaded by profile_loader and used on a later frame, see UseLoadedProfile.
+static void SelectProfileByName(std::string_view name) {
+    if (name.empty()) {
+        profile_loader.Cancel();
+        UseProfile(ProfileManager::NO_PROFILE);
+        return;
+    }
+    ActiveProfile profile;
+    profile_manager.DescribeProfile(name, profile);
+    profile_loader.Request(profile);
+}
+
+static void UseLoadedProfile() {
+    ActiveProfile profile;
+    bool loaded;
+    std::string error;
+    if (!profile_loader.TakeLoaded(profile, loaded, error)) {
+        return;
+    }
+    if (!loaded) {
+        std::cerr << "cycle-custom-layouts: can't select profile " << profile.name << ": " << error
+                  << std::endl;
+        return;
+    }
+    const std::size_t index = profile_manager.UseLoaded(profile);
+    if (index == ProfileManager::NO_PROFILE) {
+        // Its layouts were unloaded while its file was checked
+        profile_manager.DescribeProfile(profile.name, profile);
+        profile_loader.Request(profile);
+        return;
+    }
+    UseProfile(index);
+}
+
+static void NextLayout() {
+    if (!custom_layouts->empty()) {
+        const u64 last = custom_layouts->size() - 1;
+        SwitchToLayout(current_custom_layout >= last ? 0 : current_custom_layout + 1);
+    }
+}
+
+static void PreviousLayout() {
+    if (!custom_layouts->empty()) {
+        const u64 last = custom_layouts->size() - 1;
+        SwitchToLayout((current_custom_layout == 0 || current_custom_layout > last)
+                           ? last
+                           : current_custom_layout - 1);
+    }
+}
+
+static void SelectLayout(u64 index) {
+    if (index < custom_layouts->size()) {
+        SwitchToLayout(index);
+    }
+}
+
+static void ToggleCustomLayout() {
+    if (layout_applier.IsCustomLayoutEnabled()) {
+        switch_coalescer.Cancel();
+        layout_transition.Cancel();
+        layout_applier.DisableCustomLayout(true);
+    } else if (!custom_layouts->empty()) {
+        SwitchToLayout(current_custom_layout >= custom_layouts->size() ? 0
+                                                                        : current_custom_layout);
+    }
+}
+
+static void RunBindingAction(const ButtonBinding& binding) {
+    switch (binding.action) {
+    case ButtonBinding::Action::Next:
+        NextLayout();
+        break;
+    case ButtonBinding::Action::Previous:
+        PreviousLayout();
+        break;
+    case ButtonBinding::Action::Select:
+        SelectLayout(binding.layout);
+        break;
+    case ButtonBinding::Action::ToggleCustomLayout:
+        ToggleCustomLayout();
+        break;
+    case ButtonBinding::Action::SelectProfile:
+        SelectProfileByName(binding.profile);
+        break;
+    }
+}
+
+// Relative paths in settings are relative to the vvctre folder
+static std::string ResolvePath(const std::string& path) {
+    const bool absolute = (!path.empty() && (path[0] == '/' || path[0] == '\\')) ||
+                          (path.size() > 1 && path[1] == ':');
+    return absolute ? path : vvctre_folder + path;
+}
+
+static void ReportLayoutPacks(const Settings& settings) {
+    for (const LayoutPackReport& report : settings.layout_pack_reports) {
+        if (!report.error.empty()) {
+            std::cerr << "cycle-custom-layouts: skipping a layout pack: " << report.error
+                      << std::endl;
+            continue;
+        }
+        std::cerr << "cycle-custom-layouts: " << report.path << ": " << report.layout_count
+                  << " layouts parsed in " << report.parse_ns / 1000 << " us, "
+                  << report.duplicate_count << " duplicates dropped" << std::endl;
+    }
+}
+
+// Swaps in newly loaded settings, settings receives the previous layouts. Doesn't read files, and
+// only restarts what's configured by settings that changed.
+static void UseSettings(Settings& settings) {
+    ReportLayoutPacks(settings);
+    input_engine.SetBindings(settings.bindings);
+    input_engine.SetPollingRate(settings.input_polling.enabled ? settings.input_polling.rate_hz : 0);
+
+    settings_file_layouts.swap(settings.programs);
+    switch_coalescer.Configure(settings.switching);
+    layout_transition.Configure(settings.transitions);
+
+    // custom_layouts keeps pointing at the active profile's layouts
+    profile_manager.UseReloaded(settings.active_profile);
+    profile_manager.SetMemoryLimit(static_cast<u64>(settings.profiles.memory_limit_kib) * 1024);
+    WatchActiveProfile();
+
+    if (settings.instrumentation != instrumentation_settings) {
+        instrumentation_settings = settings.instrumentation;
+        if (settings.instrumentation.enabled) {
+            Instrumentation::Start(ResolvePath(settings.instrumentation.output),
+                                   settings.instrumentation.flush_interval_ms);
+        } else {
+            Instrumentation::Stop();
+        }
+    }
+
+    if (!settings.trace.enabled) {
+        input_trace.Stop();
+    } else if (input_trace.IsRecording()) {
+        input_trace.OnReload(settings.trace_settings_contents, settings.bindings);
+    } else {
+        input_trace.Start(ResolvePath(settings.trace.output), settings.trace_settings_contents,
+                          settings.bindings);
+    }
+
+    if (settings.live_state.enabled) {
+        const std::string path = ResolvePath(settings.live_state.path);
+        if (live_state.GetPath() != path && !live_state.Open(path)) {
+            std::cerr << "cycle-custom-layouts: failed to map " << path << std::endl;
+        }
+    } else {
+        live_state.Close();
+    }
+
+    if (settings.watch_settings_file && !settings_watcher.IsRunning()) {
+        settings_watcher.Start(settings_file_path);
+    } else if (!settings.watch_settings_file && settings_watcher.IsRunning()) {
+        settings_watcher.Stop();
+    }
+
+    if (settings.control_socket.enabled) {
+#ifdef _WIN32
+        // A pipe name
+        const std::string& path = settings.control_socket.path;
+#else
+        const std::string path = ResolvePath(settings.control_socket.path);
+#endif
+        if (control_server.IsRunning() && control_server.GetPath() != path) {
+            control_server.Stop();
+        }
+        if (!control_server.IsRunning()) {
+            control_server.Start(path);
+        }
+    } else {
+        control_server.Stop();
+    }
+}
+
+// Reloads the settings file, asynchronously if the settings watcher is running
+static void ReloadSettings(bool apply_settings) {
+    // The settings watcher's reload loads the first layout, see BeforeDrawingFPS
+    if (settings_watcher.IsRunning()) {
+        settings_watcher.RequestReload();
+        return;
+    }
+
+    Settings settings;
+    std::string error;
+    if (LoadSettings(settings_file_path, settings, error)) {
+        ActiveProfile& profile = settings.active_profile;
+        profile_manager.DescribeActive(profile);
+        if (!profile.name.empty() && !ProfileManager::ReloadIfChanged(profile, error)) {
+            std::cerr << "cycle-custom-layouts: keeping the layouts of profile " << profile.name
+                      << ": " << error << std::endl;
+        }
+        UseSettings(settings);
+        Instrumentation::Increment(Instrumentation::Counter::Reloads);
+    } else {
+        std::cerr << "cycle-custom-layouts: " << error << std::endl;
+    }
+
+    if (!custom_layouts->empty()) {
+        layout_applier.Reset();
+        layout_applier.Apply((*custom_layouts)[0], apply_settings);
+        current_custom_layout = 0;
+    }
+}
+
+static void RunControlCommand(const ControlCommand& command) {
+    const std::string_view text(command.text, command.text_length);
+    switch (command.type) {
+    case ControlCommand::Type::Next:
+        NextLayout();
+        break;
+    case ControlCommand::Type::Previous:
+        PreviousLayout();
+        break;
+    case ControlCommand::Type::Select:
+        SelectLayout(command.index);
+        break;
+    case ControlCommand::Type::SelectName:
+        SelectLayout(custom_layouts->FindByName(text));
+        break;
+    case ControlCommand::Type::SelectProfile:
+        SelectProfileByName(text);
+        break;
+    case ControlCommand::Type::Reload:
+        ReloadSettings(true);
+        break;
+    }
+}
 
 VVCTRE_PLUGIN_EXPORT int GetRequiredFunctionCount() {
-    return 19;
+    return REQUIRED_FUNCTION_COUNT;
 }
 
 VVCTRE_PLUGIN_EXPORT const char** GetRequiredFunctionNames() {
@@ -123,286 +350,194 @@ VVCTRE_PLUGIN_EXPORT const char** GetRequiredFunctionNames() {
 VVCTRE_PLUGIN_EXPORT void PluginLoaded(void* core, void* plugin_manager_,
                                        void* required_functions[]) {
     plugin_manager = plugin_manager_;
-    vvctre_settings_set_custom_layout_top_left =
-        (vvctre_settings_set_custom_layout_top_left_t)required_functions[0];
-    vvctre_settings_set_custom_layout_top_top =
-        (vvctre_settings_set_custom_layout_top_top_t)required_functions[1];
-    vvctre_settings_set_custom_layout_top_right =
-        (vvctre_settings_set_custom_layout_top_right_t)required_functions[2];
-    vvctre_settings_set_custom_layout_top_bottom =
-        (vvctre_settings_set_custom_layout_top_bottom_t)required_functions[3];
-    vvctre_settings_set_custom_layout_bottom_left =
-        (vvctre_settings_set_custom_layout_bottom_left_t)required_functions[4];
-    vvctre_settings_set_custom_layout_bottom_top =
-        (vvctre_settings_set_custom_layout_bottom_top_t)required_functions[5];
-    vvctre_settings_set_custom_layout_bottom_right =
-        (vvctre_settings_set_custom_layout_bottom_right_t)required_functions[6];
-    vvctre_settings_set_custom_layout_bottom_bottom =
-        (vvctre_settings_set_custom_layout_bottom_bottom_t)required_functions[7];
-    vvctre_button_device_new = (vvctre_button_device_new_t)required_functions[8];
-    vvctre_button_device_get_state = (vvctre_button_device_get_state_t)required_functions[9];
-    vvctre_settings_apply = (vvctre_settings_apply_t)required_functions[10];
-    vvctre_settings_set_use_custom_layout =
-        (vvctre_settings_set_use_custom_layout_t)required_functions[11];
-    vvctre_set_os_window_size = (vvctre_set_os_window_size_t)required_functions[12];
-    vvctre_set_os_window_position = (vvctre_set_os_window_position_t)required_functions[13];
-    vvctre_settings_set_upright_screens =
-        (vvctre_settings_set_upright_screens_t)required_functions[14];
-    vvctre_gui_begin_menu =
-        (vvctre_gui_begin_menu_t)required_functions[15];
-    vvctre_gui_end_menu =
-        (vvctre_gui_end_menu_t)required_functions[16];
-    vvctre_gui_menu_item =
-        (vvctre_gui_menu_item_t)required_functions[17];
-    vvctre_button_device_delete = (vvctre_button_device_delete_t)required_functions[18];
+    LoadHostFunctions(required_functions);
+
+    vvctre_folder = GetVvctreFolder();
+    settings_file_path = GetSettingsFilePath(vvctre_folder);
+    settings_prefetcher.Start(settings_file_path);
 }
 
 VVCTRE_PLUGIN_EXPORT void InitialSettingsOpening() {
-    int length = wai_getExecutablePath(nullptr, 0, nullptr);
-    std::string vvctre_folder(length, '\0');
-    int dirname_length = 0;
-    wai_getExecutablePath(&vvctre_folder[0], length, &dirname_length);
-    vvctre_folder = vvctre_folder.substr(0, dirname_length);
-
-    std::ifstream file;
-#ifdef _MSC_VER
-    file.open(Common::UTF8ToUTF16W(vvctre_folder + "\\cycle-custom-layouts-plugin-settings.json"));
+#ifdef _WIN32
+    profile_manager.Open(vvctre_folder + "cycle-custom-layouts-plugin-profiles\\");
 #else
-    file.open(vvctre_folder + "/cycle-custom-layouts-plugin-settings.json");
+    profile_manager.Open(vvctre_folder + "cycle-custom-layouts-plugin-profiles/");
 #endif
 
-    if (!file.fail()) {
-        std::ostringstream oss;
-        oss << file.rdbuf();
+    Settings settings;
+    bool loaded;
+    std::string error;
+    // The prefetch only takes this long if the file is on a stalled drive, parsing it here keeps
+    // the layout cache to the worker.
+    if (!settings_prefetcher.Take(std::chrono::seconds(3), settings, loaded, error)) {
+        std::cerr << "cycle-custom-layouts: loading the settings in the background is taking too "
+                     "long, parsing them again"
+                  << std::endl;
+        loaded = ParseSettings(settings_file_path, settings, error);
+    }
+    if (loaded) {
+        load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time =
+            settings.load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time;
+        UseSettings(settings);
+    } else {
+        std::cerr << "cycle-custom-layouts: " << error << std::endl;
+    }
 
-        const nlohmann::json json = nlohmann::json::parse(oss.str());
+    if (load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time && !custom_layouts->empty()) {
+        layout_applier.Apply((*custom_layouts)[0], false);
+        current_custom_layout = 0;
+    }
+    PublishLiveState();
+}
 
-        button = vvctre_button_device_new(plugin_manager, json["button"].get<std::string>().c_str());
+VVCTRE_PLUGIN_EXPORT void EmulationStarting() {
+    input_trace.OnHook(InputTrace::Event::EmulationStarting);
+    // Only calls what changed since InitialSettingsOpening
+    if (load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time && !custom_layouts->empty()) {
+        layout_applier.Apply((*custom_layouts)[0], false);
+    }
+    PublishLiveState();
+}
 
-        if (json.count("load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time")) {
-            load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time = json["load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time"].get<bool>();
-        }
+VVCTRE_PLUGIN_EXPORT void EmulatorClosing() {
+    input_trace.OnHook(InputTrace::Event::EmulatorClosing);
+    settings_prefetcher.Join();
+    profile_loader.Stop();
+    profile_manager.WriteIndexIfOutdated();
+    control_server.Stop();
+    settings_watcher.Stop();
+    input_engine.Clear();
+    live_state.Close();
+    Instrumentation::Stop();
+    instrumentation_settings = InstrumentationSettings();
+}
 
-        for (const nlohmann::json& json_layout : json["layouts"]) {
-            CustomLayout custom_layout{};
-            custom_layout.top_screen = CustomLayout::Screen{
-                json_layout["top_screen"]["left"].get<u16>(),
-                json_layout["top_screen"]["top"].get<u16>(),
-                json_layout["top_screen"]["right"].get<u16>(),
-                json_layout["top_screen"]["bottom"].get<u16>(),
-            };
-            custom_layout.bottom_screen = CustomLayout::Screen{
-                json_layout["bottom_screen"]["left"].get<u16>(),
-                json_layout["bottom_screen"]["top"].get<u16>(),
-                json_layout["bottom_screen"]["right"].get<u16>(),
-                json_layout["bottom_screen"]["bottom"].get<u16>(),
-            };
-            if (json_layout.count("resize_window")) {
-                custom_layout.resize_window = CustomLayout::ResizeWindow{
-                    json_layout["resize_window"]["enabled"].get<bool>(),
-                    json_layout["resize_window"]["width"].get<int>(),
-                    json_layout["resize_window"]["height"].get<int>(),
-                };
-            }
-            if (json_layout.count("move_window")) {
-                custom_layout.move_window = CustomLayout::MoveWindow{
-                    json_layout["move_window"]["enabled"].get<bool>(),
-                    json_layout["move_window"]["x"].get<int>(),
-                    json_layout["move_window"]["y"].get<int>(),
-                };
-            }
-            if (json_layout.count("upright")) {
-                custom_layout.upright = json_layout["upright"].get<bool>();
+VVCTRE_PLUGIN_EXPORT void BeforeDrawingFPS() {
+    Instrumentation::ScopedTimer timer(Instrumentation::Metric::BeforeDrawingFPS);
+
+    if (Settings* loaded_settings = settings_watcher.TakeLoadedSettings()) {
+        // Reloads from the Reload menu item or command load the first layout
+        const bool load_first_layout = loaded_settings->reload_requested;
+        UseSettings(*loaded_settings);
+        settings_watcher.Retire(loaded_settings);
+        Instrumentation::Increment(Instrumentation::Counter::Reloads);
+
+        if (custom_layouts->empty()) {
+            current_custom_layout = -1;
+        } else if (load_first_layout || current_custom_layout != static_cast<u64>(-1)) {
+            if (load_first_layout || current_custom_layout >= custom_layouts->size()) {
+                current_custom_layout = 0;
             }
-            custom_layouts.push_back(custom_layout);
+            layout_applier.Reset();
+            layout_applier.Apply((*custom_layouts)[current_custom_layout], true);
         }
     }
 
-    if (load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time && !custom_layouts.empty()) {
-        vvctre_settings_set_use_custom_layout(true);
-        if (custom_layouts[0].upright) {
-            vvctre_settings_set_upright_screens(*custom_layouts[0].upright);
-        }
-        vvctre_settings_set_custom_layout_top_left(custom_layouts[0].top_screen.left);
-        vvctre_settings_set_custom_layout_top_top(custom_layouts[0].top_screen.top);
-        vvctre_settings_set_custom_layout_top_right(custom_layouts[0].top_screen.right);
-        vvctre_settings_set_custom_layout_top_bottom(custom_layouts[0].top_screen.bottom);
-        vvctre_settings_set_custom_layout_bottom_left(custom_layouts[0].bottom_screen.left);
-        vvctre_settings_set_custom_layout_bottom_top(custom_layouts[0].bottom_screen.top);
-        vvctre_settings_set_custom_layout_bottom_right(custom_layouts[0].bottom_screen.right);
-        vvctre_settings_set_custom_layout_bottom_bottom(custom_layouts[0].bottom_screen.bottom);
-        if (custom_layouts[0].resize_window.enabled) {
-            vvctre_set_os_window_size(plugin_manager, custom_layouts[0].resize_window.width,
-                                      custom_layouts[0].resize_window.height);
-        }
-        if (custom_layouts[0].move_window.enabled) {
-            vvctre_set_os_window_position(plugin_manager,
-                                          custom_layouts[0].move_window.x,
-                                          custom_layouts[0].move_window.y);
-        }
-        current_custom_layout = 0;
+    UseLoadedProfile();
+
+    layout_transition.Step(layout_applier);
+
+    if (switch_coalescer.OnFrame()) {
+        PushCurrentLayout();
     }
-}
 
-VVCTRE_PLUGIN_EXPORT void EmulationStarting() {
-    if (load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time && !custom_layouts.empty()) {
-        vvctre_settings_set_use_custom_layout(true);
-        if (custom_layouts[0].upright) {
-            vvctre_settings_set_upright_screens(*custom_layouts[0].upright);
-        }
-        vvctre_settings_set_custom_layout_top_left(custom_layouts[0].top_screen.left);
-        vvctre_settings_set_custom_layout_top_top(custom_layouts[0].top_screen.top);
-        vvctre_settings_set_custom_layout_top_right(custom_layouts[0].top_screen.right);
-        vvctre_settings_set_custom_layout_top_bottom(custom_layouts[0].top_screen.bottom);
-        vvctre_settings_set_custom_layout_bottom_left(custom_layouts[0].bottom_screen.left);
-        vvctre_settings_set_custom_layout_bottom_top(custom_layouts[0].bottom_screen.top);
-        vvctre_settings_set_custom_layout_bottom_right(custom_layouts[0].bottom_screen.right);
-        vvctre_settings_set_custom_layout_bottom_bottom(custom_layouts[0].bottom_screen.bottom);
-        if (custom_layouts[0].resize_window.enabled) {
-            vvctre_set_os_window_size(plugin_manager, custom_layouts[0].resize_window.width,
-                                      custom_layouts[0].resize_window.height);
-        }
-        if (custom_layouts[0].move_window.enabled) {
-            vvctre_set_os_window_position(plugin_manager,
-                                          custom_layouts[0].move_window.x,
-                                          custom_layouts[0].move_window.y);
+    u64 released = input_engine.Poll();
+    input_trace.OnFrame(input_engine.GetState());
+    while (released != 0) {
+        RunBindingAction(input_engine.GetBinding(GetLowestSetBit(released)));
+        released &= released - 1;
+    }
+    InputEngine::Release release;
+    while (input_engine.TakeRelease(release)) {
+        RunBindingAction(input_engine.GetBinding(release.binding));
+        if (Instrumentation::IsEnabled()) {
+            Instrumentation::Record(Instrumentation::Metric::InputLatency,
+                                    Instrumentation::Now() - release.timestamp);
         }
     }
-}
 
-VVCTRE_PLUGIN_EXPORT void BeforeDrawingFPS() {
-    if (button == nullptr) {
-        return;
+    ControlCommand command;
+    while (control_server.TryPop(command)) {
+        RunControlCommand(command);
+    }
+    if (control_server.IsRunning()) {
+        control_server.PublishStatus(current_custom_layout, custom_layouts->size(),
+                                     layout_applier.IsCustomLayoutEnabled());
     }
+    PublishLiveState();
+}
 
-    if (!button_pressed && vvctre_button_device_get_state(button)) {
-        button_pressed = true;
-    } else if (button_pressed && !vvctre_button_device_get_state(button)) {
-        current_custom_layout = (current_custom_layout == (custom_layouts.size() - 1))
-                                    ? 0
-                                    : (current_custom_layout + 1);
-        vvctre_settings_set_use_custom_layout(true);
-        if (custom_layouts[current_custom_layout].upright) {
-            vvctre_settings_set_upright_screens(*custom_layouts[current_custom_layout].upright);
-        }
-        vvctre_settings_set_custom_layout_top_left(
-            custom_layouts[current_custom_layout].top_screen.left);
-        vvctre_settings_set_custom_layout_top_top(
-            custom_layouts[current_custom_layout].top_screen.top);
-        vvctre_settings_set_custom_layout_top_right(
-            custom_layouts[current_custom_layout].top_screen.right);
-        vvctre_settings_set_custom_layout_top_bottom(
-            custom_layouts[current_custom_layout].top_screen.bottom);
-        vvctre_settings_set_custom_layout_bottom_left(
-            custom_layouts[current_custom_layout].bottom_screen.left);
-        vvctre_settings_set_custom_layout_bottom_top(
-            custom_layouts[current_custom_layout].bottom_screen.top);
-        vvctre_settings_set_custom_layout_bottom_right(
-            custom_layouts[current_custom_layout].bottom_screen.right);
-        vvctre_settings_set_custom_layout_bottom_bottom(
-            custom_layouts[current_custom_layout].bottom_screen.bottom);
-        vvctre_settings_apply();
-        if (custom_layouts[current_custom_layout].resize_window.enabled) {
-            vvctre_set_os_window_size(plugin_manager,
-                                      custom_layouts[current_custom_layout].resize_window.width,
-                                      custom_layouts[current_custom_layout].resize_window.height);
-        }
-        if (custom_layouts[current_custom_layout].move_window.enabled) {
-            vvctre_set_os_window_position(plugin_manager,
-                                          custom_layouts[current_custom_layout].move_window.x,
-                                          custom_layouts[current_custom_layout].move_window.y);
-        }
-        button_pressed = false;
+// vvctre_gui_menu_item for items that do something, clicks are recorded in the input trace
+static bool MenuItem(const char* label) {
+    if (!vvctre_gui_menu_item(label)) {
+        return false;
     }
+    input_trace.OnMenuClick(label);
+    return true;
 }
 
 VVCTRE_PLUGIN_EXPORT void AddMenu() {
     if (vvctre_gui_begin_menu("Cycle Custom Layouts")) {
-        if (vvctre_gui_menu_item("Reload (loads first layout)")) {
-            int length = wai_getExecutablePath(nullptr, 0, nullptr);
-            std::string vvctre_folder(length, '\0');
-            int dirname_length = 0;
-            wai_getExecutablePath(&vvctre_folder[0], length, &dirname_length);
-            vvctre_folder = vvctre_folder.substr(0, dirname_length);
-
-            std::ifstream file;
-#ifdef _MSC_VER
-            file.open(Common::UTF8ToUTF16W(vvctre_folder + "\\cycle-custom-layouts-plugin-settings.json"));
-#else
-            file.open(vvctre_folder + "/cycle-custom-layouts-plugin-settings.json");
-#endif
-
-            if (!file.fail()) {
-                std::ostringstream oss;
-                oss << file.rdbuf();
-
-                const nlohmann::json json = nlohmann::json::parse(oss.str());
-
-                vvctre_button_device_delete(plugin_manager, button);
-                button = vvctre_button_device_new(plugin_manager, json["button"].get<std::string>().c_str());
-
-                custom_layouts.clear();
-
-                for (const nlohmann::json& json_layout : json["layouts"]) {
-                    CustomLayout custom_layout{};
-                    custom_layout.top_screen = CustomLayout::Screen{
-                        json_layout["top_screen"]["left"].get<u16>(),
-                        json_layout["top_screen"]["top"].get<u16>(),
-                        json_layout["top_screen"]["right"].get<u16>(),
-                        json_layout["top_screen"]["bottom"].get<u16>(),
-                    };
-                    custom_layout.bottom_screen = CustomLayout::Screen{
-                        json_layout["bottom_screen"]["left"].get<u16>(),
-                        json_layout["bottom_screen"]["top"].get<u16>(),
-                        json_layout["bottom_screen"]["right"].get<u16>(),
-                        json_layout["bottom_screen"]["bottom"].get<u16>(),
-                    };
-                    if (json_layout.count("resize_window")) {
-                        custom_layout.resize_window = CustomLayout::ResizeWindow{
-                            json_layout["resize_window"]["enabled"].get<bool>(),
-                            json_layout["resize_window"]["width"].get<int>(),
-                            json_layout["resize_window"]["height"].get<int>(),
-                        };
-                    }
-                    if (json_layout.count("move_window")) {
-                        custom_layout.move_window = CustomLayout::MoveWindow{
-                            json_layout["move_window"]["enabled"].get<bool>(),
-                            json_layout["move_window"]["x"].get<int>(),
-                            json_layout["move_window"]["y"].get<int>(),
-                        };
-                    }
-                    if (json_layout.count("upright")) {
-                        custom_layout.upright = json_layout["upright"].get<bool>();
-                    }
-                    custom_layouts.push_back(custom_layout);
-                }
+        if (MenuItem("Reload (loads first layout)")) {
+            ReloadSettings(false);
+        }
+        const std::size_t picked_layout =
+            layout_picker.Draw(*custom_layouts, current_custom_layout, MenuItem);
+        if (picked_layout != LayoutPicker::NONE) {
+            SelectLayout(picked_layout);
+        }
+        if (vvctre_gui_begin_menu("Profiles")) {
+            if (!profile_manager.IsScanned()) {
+                profile_manager.Scan();
             }
-
-            if (!custom_layouts.empty()) {
-                vvctre_settings_set_use_custom_layout(true);
-                if (custom_layouts[0].upright) {
-                    vvctre_settings_set_upright_screens(*custom_layouts[0].upright);
-                }
-                vvctre_settings_set_custom_layout_top_left(custom_layouts[0].top_screen.left);
-                vvctre_settings_set_custom_layout_top_top(custom_layouts[0].top_screen.top);
-                vvctre_settings_set_custom_layout_top_right(custom_layouts[0].top_screen.right);
-                vvctre_settings_set_custom_layout_top_bottom(custom_layouts[0].top_screen.bottom);
-                vvctre_settings_set_custom_layout_bottom_left(custom_layouts[0].bottom_screen.left);
-                vvctre_settings_set_custom_layout_bottom_top(custom_layouts[0].bottom_screen.top);
-                vvctre_settings_set_custom_layout_bottom_right(custom_layouts[0].bottom_screen.right);
-                vvctre_settings_set_custom_layout_bottom_bottom(custom_layouts[0].bottom_screen.bottom);
-                if (custom_layouts[0].resize_window.enabled) {
-                    vvctre_set_os_window_size(plugin_manager, custom_layouts[0].resize_window.width,
-                                              custom_layouts[0].resize_window.height);
+            const std::size_t active = profile_manager.GetActive();
+            if (MenuItem(active == ProfileManager::NO_PROFILE ? "Settings file (active)"
+                                                              : "Settings file")) {
+                SelectProfileByName("");
+            }
+            char label[256];
+            for (std::size_t i = 0; i < profile_manager.GetCount(); ++i) {
+                const ProfileManager::Profile& profile = profile_manager.GetProfile(i);
+                const char* suffix = i == active ? ", active" : "";
+                if (profile.layout_count == ProfileManager::UNKNOWN_LAYOUT_COUNT) {
+                    std::snprintf(label, sizeof(label), "%s (not loaded yet%s)",
+                                  profile.name.c_str(), suffix);
+                } else {
+                    std::snprintf(label, sizeof(label), "%s (%u layouts%s)",
+                                  profile.name.c_str(), profile.layout_count, suffix);
                 }
-                if (custom_layouts[0].move_window.enabled) {
-                    vvctre_set_os_window_position(plugin_manager,
-                                                  custom_layouts[0].move_window.x,
-                                                  custom_layouts[0].move_window.y);
+                if (MenuItem(label)) {
+                    SelectProfileByName(profile.name);
                 }
-                current_custom_layout = 0;
             }
+            if (MenuItem("Rescan profiles")) {
+                profile_manager.Scan();
+            }
+            vvctre_gui_end_menu();
+        }
+        if (Instrumentation::IsEnabled() && vvctre_gui_begin_menu("Instrumentation")) {
+            char label[128];
+            for (int i = 0; i < static_cast<int>(Instrumentation::Metric::Count); ++i) {
+                const Instrumentation::Metric metric = static_cast<Instrumentation::Metric>(i);
+                const Instrumentation::Histogram& histogram =
+                    Instrumentation::GetHistogram(metric);
+                std::snprintf(label, sizeof(label), "%s: p50 %.1f us, p99 %.1f us (%llu)",
+                              Instrumentation::GetName(metric),
+                              histogram.GetPercentile(50.0) / 1000.0,
+                              histogram.GetPercentile(99.0) / 1000.0,
+                              static_cast<unsigned long long>(histogram.GetCount()));
+                vvctre_gui_menu_item(label);
+            }
+            for (int i = 0; i < static_cast<int>(Instrumentation::Counter::Count); ++i) {
+                const Instrumentation::Counter counter = static_cast<Instrumentation::Counter>(i);
+                std::snprintf(label, sizeof(label), "%s: %llu", Instrumentation::GetName(counter),
+                              static_cast<unsigned long long>(Instrumentation::GetCounter(counter)));
+                vvctre_gui_menu_item(label);
+            }
+            vvctre_gui_end_menu();
         }
         vvctre_gui_end_menu();
+        // The menu can switch layouts or reload the settings
+        PublishLiveState();
     }
 }
@@ -0,0 +1,99 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "profile_loader.h"
+#include "profiles.h"
+
+ProfileLoader::~ProfileLoader() {
+    Stop();
+}
+
+void ProfileLoader::Request(const ActiveProfile& profile) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        request = ActiveProfile();
+        request.name = profile.name;
+        request.path = profile.path;
+        request.stamp = profile.stamp;
+        request_generation = ++generation;
+        has_request = true;
+    }
+    if (!thread.joinable()) {
+        stop_requested = false;
+        thread = std::thread(&ProfileLoader::Run, this);
+    } else {
+        condition_variable.notify_one();
+    }
+}
+
+void ProfileLoader::Cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++generation;
+    has_request = false;
+}
+
+bool ProfileLoader::TakeLoaded(ActiveProfile& profile, bool& loaded, std::string& error) {
+    if (!has_result.load(std::memory_order_acquire)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    has_result.store(false, std::memory_order_relaxed);
+    if (result_generation != generation) {
+        return false;
+    }
+    profile.name = std::move(result.name);
+    profile.path = std::move(result.path);
+    profile.stamp = result.stamp;
+    profile.reloaded = result.reloaded;
+    profile.programs.swap(result.programs);
+    loaded = result_loaded;
+    error = std::move(result_error);
+    return true;
+}
+
+void ProfileLoader::Stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop_requested = true;
+        has_request = false;
+    }
+    condition_variable.notify_one();
+    thread.join();
+    has_result.store(false, std::memory_order_relaxed);
+    result = ActiveProfile();
+}
+
+void ProfileLoader::Run() {
+    while (true) {
+        ActiveProfile profile;
+        u64 profile_generation;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition_variable.wait(lock, [this] { return stop_requested || has_request; });
+            if (stop_requested) {
+                return;
+            }
+            profile = std::move(request);
+            profile_generation = request_generation;
+            has_request = false;
+        }
+
+        std::string error;
+        const bool loaded = ProfileManager::ReloadIfChanged(profile, error);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        // A newer request replaces this one, and an untaken result is outdated
+        if (profile_generation != generation) {
+            continue;
+        }
+        result = std::move(profile);
+        result_loaded = loaded;
+        result_error = std::move(error);
+        result_generation = profile_generation;
+        has_result.store(true, std::memory_order_release);
+    }
+}
@@ -0,0 +1,62 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "settings.h"
+
+/**
+ * Loads selected profiles on a worker thread, so selecting a profile never lists the profiles
+ * folder or parses a settings file in the frame hook. The frame hook hands the result over on a
+ * later frame. Only the newest request counts: a request replaces the one waiting, and the result
+ * of a load that was requested before another one or a Cancel is dropped.
+ */
+class ProfileLoader {
+public:
+    ~ProfileLoader();
+
+    /**
+     * Loads profile, see ProfileManager::DescribeProfile and ProfileManager::ReloadIfChanged.
+     * Starts the worker thread the first time.
+     */
+    void Request(const ActiveProfile& profile);
+
+    /// Drops the waiting request and the result of the running load.
+    void Cancel();
+
+    /**
+     * Moves the result of the newest request out once it's loaded. loaded tells whether the
+     * profile could be loaded, error why not. One atomic load when there's no result.
+     */
+    bool TakeLoaded(ActiveProfile& profile, bool& loaded, std::string& error);
+
+    /// Waits for the running load, drops the waiting request, and stops the worker thread.
+    void Stop();
+
+private:
+    void Run();
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+    bool stop_requested = false;
+    /// Incremented by every Request and Cancel, a result is only taken if it has the newest
+    u64 generation = 0;
+
+    bool has_request = false;
+    ActiveProfile request;
+    u64 request_generation = 0;
+
+    std::atomic<bool> has_result{false};
+    ActiveProfile result;
+    bool result_loaded = false;
+    std::string result_error;
+    u64 result_generation = 0;
+};
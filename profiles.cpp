@@ -0,0 +1,299 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "profiles.h"
+#include "settings.h"
+
+namespace {
+
+struct ProfileIndexHeader {
+    u32 magic;
+    u32 version;
+    u32 profile_count;
+    u32 names_size;
+};
+
+struct ProfileIndexEntry {
+    u64 size;
+    s64 modification_time;
+    u32 layout_count;
+    u32 name_offset;
+    u32 name_length;
+    u8 padding[4];
+};
+static_assert(sizeof(ProfileIndexEntry) == 32);
+
+constexpr u32 PROFILE_INDEX_MAGIC = 0x49504343; // CCPI
+constexpr u32 PROFILE_INDEX_VERSION = 1;
+constexpr char PROFILE_EXTENSION[] = ".json";
+
+} // Anonymous namespace
+
+std::string ProfileManager::GetIndexPath() const {
+    return folder + "profiles.index";
+}
+
+void ProfileManager::Open(const std::string& folder_) {
+    folder = folder_;
+    profiles.clear();
+    active = NO_PROFILE;
+    scanned = false;
+    index_outdated = false;
+
+    FileUtil::MappedFile index;
+    if (!index.Open(GetIndexPath()) || index.Size() < sizeof(ProfileIndexHeader)) {
+        return;
+    }
+    ProfileIndexHeader header;
+    std::memcpy(&header, index.Data(), sizeof(header));
+    const std::size_t entries_size =
+        static_cast<std::size_t>(header.profile_count) * sizeof(ProfileIndexEntry);
+    if (header.magic != PROFILE_INDEX_MAGIC || header.version != PROFILE_INDEX_VERSION ||
+        index.Size() != sizeof(header) + entries_size + header.names_size) {
+        return;
+    }
+
+    const u8* entries = index.Data() + sizeof(header);
+    const char* names = reinterpret_cast<const char*>(entries + entries_size);
+    profiles.resize(header.profile_count);
+    for (u32 i = 0; i < header.profile_count; ++i) {
+        ProfileIndexEntry entry;
+        std::memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+        if (static_cast<u64>(entry.name_offset) + entry.name_length > header.names_size) {
+            profiles.clear();
+            return;
+        }
+        Profile& profile = profiles[i];
+        profile.name.assign(names + entry.name_offset, entry.name_length);
+        profile.layout_count = entry.layout_count;
+        profile.stamp = FileUtil::FileStamp{entry.size, entry.modification_time};
+    }
+}
+
+void ProfileManager::WriteIndex() {
+    std::vector<ProfileIndexEntry> entries(profiles.size());
+    std::string names;
+    for (std::size_t i = 0; i < profiles.size(); ++i) {
+        const Profile& profile = profiles[i];
+        ProfileIndexEntry& entry = entries[i];
+        entry = ProfileIndexEntry{};
+        entry.size = profile.stamp.size;
+        entry.modification_time = profile.stamp.modification_time;
+        entry.layout_count = profile.layout_count;
+        entry.name_offset = static_cast<u32>(names.size());
+        entry.name_length = static_cast<u32>(profile.name.size());
+        names += profile.name;
+    }
+
+    const ProfileIndexHeader header{PROFILE_INDEX_MAGIC, PROFILE_INDEX_VERSION,
+                                    static_cast<u32>(profiles.size()),
+                                    static_cast<u32>(names.size())};
+    const std::size_t entries_size = entries.size() * sizeof(ProfileIndexEntry);
+    std::vector<u8> contents(sizeof(header) + entries_size + names.size());
+    std::memcpy(contents.data(), &header, sizeof(header));
+    if (entries_size != 0) {
+        std::memcpy(contents.data() + sizeof(header), entries.data(), entries_size);
+    }
+    std::memcpy(contents.data() + sizeof(header) + entries_size, names.data(), names.size());
+
+    // Not being able to write the index only means the next start doesn't know the profiles
+    FileUtil::WriteFileAtomically(GetIndexPath(), contents.data(), contents.size());
+    index_outdated = false;
+}
+
+void ProfileManager::Scan() {
+    std::vector<std::string> names = FileUtil::ListFiles(folder, PROFILE_EXTENSION);
+    for (std::string& name : names) {
+        name.resize(name.size() - (sizeof(PROFILE_EXTENSION) - 1));
+    }
+
+    const std::string active_name = active == NO_PROFILE ? "" : profiles[active].name;
+    if (active != NO_PROFILE &&
+        std::find(names.begin(), names.end(), active_name) == names.end()) {
+        // Its layouts are in use
+        names.push_back(active_name);
+    }
+    std::sort(names.begin(), names.end());
+
+    std::vector<Profile> scanned_profiles(names.size());
+    std::size_t scanned_active = NO_PROFILE;
+    bool changed = names.size() != profiles.size();
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        // Before the name is moved
+        if (active != NO_PROFILE && names[i] == active_name) {
+            scanned_active = i;
+        }
+        const auto old = std::find_if(profiles.begin(), profiles.end(),
+                                      [&](const Profile& profile) { return profile.name == names[i]; });
+        Profile& profile = scanned_profiles[i];
+        if (old == profiles.end()) {
+            profile.name = std::move(names[i]);
+            changed = true;
+        } else {
+            if (!changed && old != profiles.begin() + i) {
+                changed = true;
+            }
+            profile = std::move(*old);
+        }
+
+        // The layout count is found again when an edited profile is loaded
+        FileUtil::FileStamp stamp;
+        if (profile.layout_count != UNKNOWN_LAYOUT_COUNT &&
+            (!FileUtil::GetFileStamp(folder + profile.name + PROFILE_EXTENSION, stamp) ||
+             stamp != profile.stamp)) {
+            profile.layout_count = UNKNOWN_LAYOUT_COUNT;
+            changed = true;
+        }
+    }
+    profiles = std::move(scanned_profiles);
+    active = scanned_active;
+    scanned = true;
+
+    if (changed || index_outdated) {
+        WriteIndex();
+    }
+}
+
+void ProfileManager::SetMemoryLimit(u64 bytes) {
+    memory_limit = bytes;
+    EnforceMemoryLimit();
+}
+
+std::size_t ProfileManager::Find(std::string_view name) const {
+    for (std::size_t i = 0; i < profiles.size(); ++i) {
+        if (profiles[i].name == name) {
+            return i;
+        }
+    }
+    return NO_PROFILE;
+}
+
+void ProfileManager::DescribeProfile(std::string_view name, ActiveProfile& profile) const {
+    profile.name = name;
+    profile.path = folder + profile.name + PROFILE_EXTENSION;
+    const std::size_t index = Find(name);
+    // A stamp no file has makes ReloadIfChanged load the profile
+    profile.stamp = index != NO_PROFILE && profiles[index].programs != nullptr
+                        ? profiles[index].stamp
+                        : FileUtil::FileStamp();
+}
+
+void ProfileManager::DescribeActive(ActiveProfile& profile) const {
+    if (active == NO_PROFILE) {
+        profile.name.clear();
+        profile.path.clear();
+        profile.stamp = FileUtil::FileStamp();
+        return;
+    }
+    DescribeProfile(profiles[active].name, profile);
+}
+
+bool ProfileManager::ReloadIfChanged(ActiveProfile& profile, std::string& error) {
+    FileUtil::FileStamp stamp;
+    if (!FileUtil::GetFileStamp(profile.path, stamp)) {
+        error = "failed to open " + profile.path;
+        return false;
+    }
+    if (stamp == profile.stamp) {
+        return true;
+    }
+
+    Settings settings;
+    if (!LoadSettings(profile.path, settings, error)) {
+        return false;
+    }
+    profile.programs.swap(settings.programs);
+    profile.stamp = stamp;
+    profile.reloaded = true;
+    return true;
+}
+
+void ProfileManager::StoreReloaded(Profile& profile, ActiveProfile& reloaded) {
+    if (profile.programs == nullptr) {
+        profile.programs = std::make_unique<LayoutPrograms>();
+    }
+    profile.programs->swap(reloaded.programs);
+    const u32 layout_count = static_cast<u32>(profile.programs->size());
+    // The index isn't written from the frame hook
+    index_outdated |= layout_count != profile.layout_count || reloaded.stamp != profile.stamp;
+    profile.layout_count = layout_count;
+    profile.stamp = reloaded.stamp;
+}
+
+std::size_t ProfileManager::UseLoaded(ActiveProfile& loaded) {
+    std::size_t index = Find(loaded.name);
+    if (index == NO_PROFILE) {
+        if (!loaded.reloaded) {
+            return NO_PROFILE;
+        }
+        // Keeps the profiles sorted like Scan does
+        const auto position =
+            std::lower_bound(profiles.begin(), profiles.end(), loaded.name,
+                             [](const Profile& profile, const std::string& name) {
+                                 return profile.name < name;
+                             });
+        index = static_cast<std::size_t>(position - profiles.begin());
+        profiles.emplace(position)->name = loaded.name;
+        if (active != NO_PROFILE && active >= index) {
+            ++active;
+        }
+        index_outdated = true;
+    }
+
+    Profile& profile = profiles[index];
+    if (loaded.reloaded) {
+        StoreReloaded(profile, loaded);
+    } else if (profile.programs == nullptr) {
+        return NO_PROFILE;
+    }
+    profile.last_used = ++use_count;
+    active = index;
+    EnforceMemoryLimit();
+    return index;
+}
+
+void ProfileManager::UseReloaded(ActiveProfile& reloaded) {
+    if (!reloaded.reloaded || active == NO_PROFILE || profiles[active].name != reloaded.name) {
+        return;
+    }
+    Profile& profile = profiles[active];
+    StoreReloaded(profile, reloaded);
+    profile.last_used = ++use_count;
+    EnforceMemoryLimit();
+}
+
+void ProfileManager::WriteIndexIfOutdated() {
+    if (index_outdated) {
+        WriteIndex();
+    }
+}
+
+void ProfileManager::EnforceMemoryLimit() {
+    u64 memory_usage = 0;
+    for (const Profile& profile : profiles) {
+        if (profile.programs != nullptr) {
+            memory_usage += profile.programs->GetMemoryUsage();
+        }
+    }
+
+    while (memory_usage > memory_limit) {
+        // The least recently used profile that isn't in use
+        Profile* evicted = nullptr;
+        for (std::size_t i = 0; i < profiles.size(); ++i) {
+            Profile& profile = profiles[i];
+            if (i != active && profile.programs != nullptr &&
+                (evicted == nullptr || profile.last_used < evicted->last_used)) {
+                evicted = &profile;
+            }
+        }
+        if (evicted == nullptr) {
+            return;
+        }
+        memory_usage -= evicted->programs->GetMemoryUsage();
+        evicted->programs.reset();
+    }
+}
@@ -0,0 +1,117 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common_types.h"
+#include "file_util.h"
+#include "layout_program.h"
+
+struct ActiveProfile;
+
+/**
+ * Layout profiles are settings files in a profiles folder, one per profile, named after the
+ * profile. Only their layouts and window_size are used.
+ * Startup only reads a small index of the profiles (name, layout count, file size and modification
+ * time), the folder is listed the first time the profiles menu is opened, and a profile's layouts
+ * are loaded on another thread when it's selected, see ProfileLoader. Profiles that aren't in use
+ * are unloaded when the loaded ones use more memory than a limit.
+ */
+class ProfileManager {
+public:
+    static constexpr std::size_t NO_PROFILE = static_cast<std::size_t>(-1);
+    static constexpr u32 UNKNOWN_LAYOUT_COUNT = static_cast<u32>(-1);
+
+    struct Profile {
+        std::string name;
+        /// UNKNOWN_LAYOUT_COUNT until the profile was loaded once
+        u32 layout_count = UNKNOWN_LAYOUT_COUNT;
+        /// Of the file when layout_count was found
+        FileUtil::FileStamp stamp;
+        /// Null when not loaded
+        std::unique_ptr<LayoutPrograms> programs;
+        u64 last_used = 0;
+    };
+
+    /// Reads the index of the profiles in folder, which ends with a separator.
+    void Open(const std::string& folder);
+
+    /// Lists the profiles folder, adding new profiles to the index and removing deleted ones.
+    void Scan();
+    bool IsScanned() const {
+        return scanned;
+    }
+
+    void SetMemoryLimit(u64 bytes);
+
+    std::size_t GetCount() const {
+        return profiles.size();
+    }
+    const Profile& GetProfile(std::size_t index) const {
+        return profiles[index];
+    }
+
+    /// Returns the index of the profile named name, or NO_PROFILE if it's not known yet.
+    std::size_t Find(std::string_view name) const;
+
+    /// The active profile is never unloaded. NO_PROFILE if the settings file's layouts are used.
+    void SetActive(std::size_t index) {
+        active = index;
+    }
+    std::size_t GetActive() const {
+        return active;
+    }
+
+    /**
+     * Sets the name and path of profile to those of the profile named name, known or not, and
+     * its stamp to the stamp of the layouts loaded for it, if any.
+     */
+    void DescribeProfile(std::string_view name, ActiveProfile& profile) const;
+    /// DescribeProfile for the active profile, or clears profile for NO_PROFILE.
+    void DescribeActive(ActiveProfile& profile) const;
+
+    /**
+     * Loads the layouts of profile if its file doesn't have profile.stamp anymore. Doesn't use a
+     * profile manager, so it can run on any thread. Returns false if the file can't be loaded.
+     */
+    static bool ReloadIfChanged(ActiveProfile& profile, std::string& error);
+
+    /**
+     * Makes a profile described by DescribeProfile and checked by ReloadIfChanged the active
+     * profile, with the layouts ReloadIfChanged loaded if any. Adds the profile if it isn't known.
+     * Doesn't read files. Returns its index, or NO_PROFILE if it wasn't reloaded and its layouts
+     * were unloaded since it was described.
+     */
+    std::size_t UseLoaded(ActiveProfile& profile);
+
+    /**
+     * Swaps the layouts reloaded by ReloadIfChanged into the active profile, if it's still the
+     * active profile. The active profile's layouts are reused, so pointers to them stay valid.
+     */
+    void UseReloaded(ActiveProfile& profile);
+
+    /// Writes the layout counts found by UseLoaded and UseReloaded to the index.
+    void WriteIndexIfOutdated();
+
+private:
+    std::string GetIndexPath() const;
+    void WriteIndex();
+    void EnforceMemoryLimit();
+    /// Swaps reloaded layouts into profile, the index is written later
+    void StoreReloaded(Profile& profile, ActiveProfile& reloaded);
+
+    std::string folder;
+    std::vector<Profile> profiles;
+    std::size_t active = NO_PROFILE;
+    bool scanned = false;
+    bool index_outdated = false;
+    u64 memory_limit = static_cast<u64>(-1);
+    u64 use_count = 0;
+};
@@ -0,0 +1,992 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include <whereami.h>
+
+#include "file_util.h"
+#include "instrumentation.h"
+#include "json_reader.h"
+#include "layout_cache.h"
+#include "layout_expression.h"
+#include "layout_packs.h"
+#include "settings.h"
+
+void LayoutTable::Assign(std::vector<CustomLayout>&& layouts, std::vector<u32>&& expression_code_,
+                         std::vector<char>&& names_) {
+    mapping.Close();
+    owned = std::move(layouts);
+    data = owned.data();
+    count = owned.size();
+    owned_expression_code = std::move(expression_code_);
+    expression_code = owned_expression_code.data();
+    expression_code_size = owned_expression_code.size();
+    owned_names = std::move(names_);
+    names = owned_names.data();
+    names_size = owned_names.size();
+}
+
+void LayoutTable::Assign(FileUtil::MappedFile&& file, const CustomLayout* layouts,
+                         std::size_t count_, const u32* expression_code_,
+                         std::size_t expression_code_size_, const char* names_,
+                         std::size_t names_size_) {
+    owned.clear();
+    owned.shrink_to_fit();
+    owned_expression_code.clear();
+    owned_expression_code.shrink_to_fit();
+    owned_names.clear();
+    owned_names.shrink_to_fit();
+    mapping = std::move(file);
+    data = layouts;
+    count = count_;
+    expression_code = expression_code_;
+    expression_code_size = expression_code_size_;
+    names = names_;
+    names_size = names_size_;
+}
+
+void LayoutTable::swap(LayoutTable& other) noexcept {
+    // Swapping the vectors and mappings keeps their buffers, so the pointers stay valid
+    owned.swap(other.owned);
+    std::swap(mapping, other.mapping);
+    std::swap(data, other.data);
+    std::swap(count, other.count);
+    owned_expression_code.swap(other.owned_expression_code);
+    std::swap(expression_code, other.expression_code);
+    std::swap(expression_code_size, other.expression_code_size);
+    owned_names.swap(other.owned_names);
+    std::swap(names, other.names);
+    std::swap(names_size, other.names_size);
+}
+
+// Rounds an expression's result and clamps it to the range of the field it's stored in
+template <typename T>
+static T ToField(double value) {
+    if (std::isnan(value)) {
+        return 0;
+    }
+    value = std::round(value);
+    if (value <= static_cast<double>(std::numeric_limits<T>::min())) {
+        return std::numeric_limits<T>::min();
+    }
+    if (value >= static_cast<double>(std::numeric_limits<T>::max())) {
+        return std::numeric_limits<T>::max();
+    }
+    return static_cast<T>(value);
+}
+
+static void SetLayoutValue(CustomLayout& layout, LayoutValue value, double result) {
+    switch (value) {
+    case LayoutValue::TopScreenLeft:
+        layout.top_screen.left = ToField<u16>(result);
+        break;
+    case LayoutValue::TopScreenTop:
+        layout.top_screen.top = ToField<u16>(result);
+        break;
+    case LayoutValue::TopScreenRight:
+        layout.top_screen.right = ToField<u16>(result);
+        break;
+    case LayoutValue::TopScreenBottom:
+        layout.top_screen.bottom = ToField<u16>(result);
+        break;
+    case LayoutValue::BottomScreenLeft:
+        layout.bottom_screen.left = ToField<u16>(result);
+        break;
+    case LayoutValue::BottomScreenTop:
+        layout.bottom_screen.top = ToField<u16>(result);
+        break;
+    case LayoutValue::BottomScreenRight:
+        layout.bottom_screen.right = ToField<u16>(result);
+        break;
+    case LayoutValue::BottomScreenBottom:
+        layout.bottom_screen.bottom = ToField<u16>(result);
+        break;
+    case LayoutValue::ResizeWindowWidth:
+        layout.resize_window.width = ToField<int>(result);
+        break;
+    case LayoutValue::ResizeWindowHeight:
+        layout.resize_window.height = ToField<int>(result);
+        break;
+    case LayoutValue::MoveWindowX:
+        layout.move_window.x = ToField<int>(result);
+        break;
+    case LayoutValue::MoveWindowY:
+        layout.move_window.y = ToField<int>(result);
+        break;
+    case LayoutValue::Count:
+        break;
+    }
+}
+
+CustomLayout LayoutTable::Resolve(std::size_t index, const WindowSize& window_size) const {
+    const CustomLayout& layout = data[index];
+    if (layout.expression_mask == 0) {
+        return layout;
+    }
+
+    // The bytecode of every expression of the layout is stored back to back
+    const u32* starts[LAYOUT_VALUE_COUNT] = {};
+    const u32* code = expression_code + layout.expression_code;
+    for (std::size_t i = 0; i < LAYOUT_VALUE_COUNT; ++i) {
+        if ((layout.expression_mask & (1u << i)) != 0) {
+            starts[i] = code;
+            code = LayoutExpression::Skip(code);
+        }
+    }
+
+    double variables[static_cast<std::size_t>(LayoutExpression::Variable::Count)] = {
+        static_cast<double>(window_size.width),
+        static_cast<double>(window_size.height),
+        5.0 / 3.0,
+        4.0 / 3.0,
+    };
+
+    CustomLayout result = layout;
+    const auto evaluate = [&](LayoutValue value) {
+        const u32* start = starts[static_cast<std::size_t>(value)];
+        if (start != nullptr) {
+            SetLayoutValue(result, value, LayoutExpression::Evaluate(start, variables, nullptr));
+        }
+    };
+
+    // The window size is evaluated first, the other values are relative to the resized window
+    evaluate(LayoutValue::ResizeWindowWidth);
+    evaluate(LayoutValue::ResizeWindowHeight);
+    if (result.resize_window.enabled) {
+        variables[static_cast<std::size_t>(LayoutExpression::Variable::Width)] =
+            result.resize_window.width;
+        variables[static_cast<std::size_t>(LayoutExpression::Variable::Height)] =
+            result.resize_window.height;
+    }
+    for (std::size_t i = 0; i < static_cast<std::size_t>(LayoutValue::ResizeWindowWidth); ++i) {
+        evaluate(static_cast<LayoutValue>(i));
+    }
+    evaluate(LayoutValue::MoveWindowX);
+    evaluate(LayoutValue::MoveWindowY);
+
+    return result;
+}
+
+std::string GetVvctreFolder() {
+    int length = wai_getExecutablePath(nullptr, 0, nullptr);
+    std::string vvctre_folder(length, '\0');
+    int dirname_length = 0;
+    wai_getExecutablePath(&vvctre_folder[0], length, &dirname_length);
+    vvctre_folder = vvctre_folder.substr(0, dirname_length);
+
+#ifdef _WIN32
+    return vvctre_folder + "\\";
+#else
+    return vvctre_folder + "/";
+#endif
+}
+
+std::string GetSettingsFilePath() {
+    return GetSettingsFilePath(GetVvctreFolder());
+}
+
+std::string GetSettingsFilePath(const std::string& vvctre_folder) {
+    return vvctre_folder + "cycle-custom-layouts-plugin-settings.json";
+}
+
+static bool ReadButtonBindings(JsonReader& reader, std::vector<ButtonBinding>& bindings) {
+    std::string key;
+    std::string action;
+    bool done;
+
+    if (!reader.BeginArray()) {
+        return false;
+    }
+    while (reader.NextElement(done) && !done) {
+        ButtonBinding binding;
+        bool has_action = false;
+        bool has_button = false;
+        bool has_layout = false;
+        bool has_profile = false;
+
+        if (!reader.BeginObject()) {
+            return false;
+        }
+        while (reader.NextMember(key, done) && !done) {
+            if (key == "action") {
+                if (!reader.ReadString(action)) {
+                    return false;
+                }
+                if (action == "next") {
+                    binding.action = ButtonBinding::Action::Next;
+                } else if (action == "previous") {
+                    binding.action = ButtonBinding::Action::Previous;
+                } else if (action == "select") {
+                    binding.action = ButtonBinding::Action::Select;
+                } else if (action == "toggle_custom_layout") {
+                    binding.action = ButtonBinding::Action::ToggleCustomLayout;
+                } else if (action == "select_profile") {
+                    binding.action = ButtonBinding::Action::SelectProfile;
+                } else {
+                    return reader.Fail("unknown binding action " + action);
+                }
+                has_action = true;
+            } else if (key == "button") {
+                if (!reader.ReadString(binding.button)) {
+                    return false;
+                }
+                has_button = true;
+            } else if (key == "profile") {
+                if (!reader.ReadString(binding.profile)) {
+                    return false;
+                }
+                has_profile = true;
+            } else if (key == "layout") {
+                s64 layout;
+                if (!reader.ReadInteger(layout, 0, std::numeric_limits<s64>::max())) {
+                    return false;
+                }
+                binding.layout = static_cast<u64>(layout);
+                has_layout = true;
+            } else if (!reader.SkipValue()) {
+                return false;
+            }
+        }
+        if (reader.HasFailed()) {
+            return false;
+        }
+        if (!has_action || !has_button) {
+            return reader.Fail("a binding needs an action and a button");
+        }
+        if (binding.action == ButtonBinding::Action::Select && !has_layout) {
+            return reader.Fail("a select binding needs a layout");
+        }
+        if (binding.action == ButtonBinding::Action::SelectProfile && !has_profile) {
+            return reader.Fail("a select_profile binding needs a profile");
+        }
+        bindings.push_back(std::move(binding));
+    }
+    return !reader.HasFailed();
+}
+
+static bool ReadInstrumentationSettings(JsonReader& reader, InstrumentationSettings& settings) {
+    std::string key;
+    bool done;
+    bool has_enabled = false;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "enabled") {
+            if (!reader.ReadBool(settings.enabled)) {
+                return false;
+            }
+            has_enabled = true;
+        } else if (key == "output") {
+            if (!reader.ReadString(settings.output)) {
+                return false;
+            }
+        } else if (key == "flush_interval_ms") {
+            s64 value;
+            if (!reader.ReadInteger(value, 0, std::numeric_limits<u32>::max())) {
+                return false;
+            }
+            settings.flush_interval_ms = static_cast<u32>(value);
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    if (reader.HasFailed()) {
+        return false;
+    }
+    return has_enabled || reader.Fail("missing instrumentation.enabled");
+}
+
+static bool ReadInputPollingSettings(JsonReader& reader, InputPollingSettings& settings) {
+    std::string key;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "enabled") {
+            if (!reader.ReadBool(settings.enabled)) {
+                return false;
+            }
+        } else if (key == "rate_hz") {
+            s64 value;
+            if (!reader.ReadInteger(value, 1, 10000)) {
+                return false;
+            }
+            settings.rate_hz = static_cast<u32>(value);
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    return !reader.HasFailed();
+}
+
+static bool ReadTraceSettings(JsonReader& reader, TraceSettings& settings) {
+    std::string key;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "enabled") {
+            if (!reader.ReadBool(settings.enabled)) {
+                return false;
+            }
+        } else if (key == "output") {
+            if (!reader.ReadString(settings.output)) {
+                return false;
+            }
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    return !reader.HasFailed();
+}
+
+static bool ReadControlSocketSettings(JsonReader& reader, ControlSocketSettings& settings) {
+    std::string key;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "enabled") {
+            if (!reader.ReadBool(settings.enabled)) {
+                return false;
+            }
+        } else if (key == "path") {
+            if (!reader.ReadString(settings.path)) {
+                return false;
+            }
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    return !reader.HasFailed();
+}
+
+static bool ReadLiveStateSettings(JsonReader& reader, LiveStateSettings& settings) {
+    std::string key;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "enabled") {
+            if (!reader.ReadBool(settings.enabled)) {
+                return false;
+            }
+        } else if (key == "path") {
+            if (!reader.ReadString(settings.path)) {
+                return false;
+            }
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    return !reader.HasFailed();
+}
+
+static bool ReadProfileSettings(JsonReader& reader, ProfileSettings& settings) {
+    std::string key;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "memory_limit_kib") {
+            s64 value;
+            if (!reader.ReadInteger(value, 0, std::numeric_limits<u32>::max())) {
+                return false;
+            }
+            settings.memory_limit_kib = static_cast<u32>(value);
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    return !reader.HasFailed();
+}
+
+static bool ReadTransitionSettings(JsonReader& reader, TransitionSettings& settings) {
+    std::string key;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "frames" || key == "frame_budget_us") {
+            s64 value;
+            if (!reader.ReadInteger(value, 0, std::numeric_limits<u32>::max())) {
+                return false;
+            }
+            (key == "frames" ? settings.frames : settings.frame_budget_us) =
+                static_cast<u32>(value);
+        } else if (key == "easing") {
+            std::string easing;
+            if (!reader.ReadString(easing)) {
+                return false;
+            }
+            if (easing == "linear") {
+                settings.easing = TransitionSettings::Easing::Linear;
+            } else if (easing == "ease_in") {
+                settings.easing = TransitionSettings::Easing::EaseIn;
+            } else if (easing == "ease_out") {
+                settings.easing = TransitionSettings::Easing::EaseOut;
+            } else if (easing == "ease_in_out") {
+                settings.easing = TransitionSettings::Easing::EaseInOut;
+            } else {
+                return reader.Fail("unknown easing " + easing);
+            }
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    return !reader.HasFailed();
+}
+
+static bool ReadSwitchingSettings(JsonReader& reader, SwitchingSettings& settings) {
+    std::string key;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "settle_frames" || key == "settle_ms") {
+            s64 value;
+            if (!reader.ReadInteger(value, 0, std::numeric_limits<u32>::max())) {
+                return false;
+            }
+            (key == "settle_frames" ? settings.settle_frames : settings.settle_ms) =
+                static_cast<u32>(value);
+        } else if (key == "apply_first_switch_immediately") {
+            if (!reader.ReadBool(settings.apply_first_switch_immediately)) {
+                return false;
+            }
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    return !reader.HasFailed();
+}
+
+// Bytecode of the expressions of the layout being read, by LayoutValue
+struct LayoutExpressions {
+    std::vector<u32> code[LAYOUT_VALUE_COUNT];
+    u16 mask = 0;
+};
+
+// Reads an integer, or if expressions is given, a string that's compiled into it
+static bool ReadLayoutValue(JsonReader& reader, LayoutValue value, s64 min, s64 max,
+                            s64& integer, LayoutExpressions* expressions) {
+    if (expressions == nullptr || reader.PeekType() != JsonReader::Type::String) {
+        return reader.ReadInteger(integer, min, max);
+    }
+
+    std::string source;
+    if (!reader.ReadString(source)) {
+        return false;
+    }
+    std::vector<u32>& code = expressions->code[static_cast<std::size_t>(value)];
+    code.clear();
+    std::string error;
+    if (!LayoutExpression::Compile(source, code, error)) {
+        return reader.Fail(error);
+    }
+    expressions->mask |= 1u << static_cast<unsigned>(value);
+    integer = 0;
+    return true;
+}
+
+// Reads an object made of integer members. Every name must be present.
+// With expressions, the members are layout values, names[i] being the value first + i.
+template <std::size_t Count>
+static bool ReadIntegers(JsonReader& reader, std::string& key, const char* object_name,
+                         const char* const (&names)[Count], s64 (&values)[Count], s64 min,
+                         s64 max, LayoutValue first = LayoutValue::Count,
+                         LayoutExpressions* expressions = nullptr) {
+    u32 found = 0;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        std::size_t i = 0;
+        while (i < Count && key != names[i]) {
+            ++i;
+        }
+        if (i == Count) {
+            if (!reader.SkipValue()) {
+                return false;
+            }
+            continue;
+        }
+        if (!ReadLayoutValue(reader, static_cast<LayoutValue>(static_cast<std::size_t>(first) + i),
+                             min, max, values[i], expressions)) {
+            return false;
+        }
+        found |= 1u << i;
+    }
+    if (reader.HasFailed()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < Count; ++i) {
+        if ((found & (1u << i)) == 0) {
+            return reader.Fail(std::string("missing ") + object_name + '.' + names[i]);
+        }
+    }
+    return true;
+}
+
+// Reads the value of a top level member other than layouts
+static bool ReadOption(JsonReader& reader, const std::string& key, Settings& settings) {
+    if (key == "button") {
+        ButtonBinding binding;
+        if (!reader.ReadString(binding.button)) {
+            return false;
+        }
+        settings.bindings.insert(settings.bindings.begin(), std::move(binding));
+        return true;
+    }
+    if (key == "bindings") {
+        return ReadButtonBindings(reader, settings.bindings);
+    }
+    if (key == "load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time") {
+        return reader.ReadBool(settings.load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time);
+    }
+    if (key == "watch_settings_file") {
+        return reader.ReadBool(settings.watch_settings_file);
+    }
+    if (key == "instrumentation") {
+        return ReadInstrumentationSettings(reader, settings.instrumentation);
+    }
+    if (key == "trace") {
+        return ReadTraceSettings(reader, settings.trace);
+    }
+    if (key == "input_polling") {
+        return ReadInputPollingSettings(reader, settings.input_polling);
+    }
+    if (key == "control_socket") {
+        return ReadControlSocketSettings(reader, settings.control_socket);
+    }
+    if (key == "live_state") {
+        return ReadLiveStateSettings(reader, settings.live_state);
+    }
+    if (key == "profiles") {
+        return ReadProfileSettings(reader, settings.profiles);
+    }
+    if (key == "transitions") {
+        return ReadTransitionSettings(reader, settings.transitions);
+    }
+    if (key == "switching") {
+        return ReadSwitchingSettings(reader, settings.switching);
+    }
+    if (key == "layout_packs") {
+        settings.layout_packs.clear();
+        bool done;
+        if (!reader.BeginArray()) {
+            return false;
+        }
+        while (reader.NextElement(done) && !done) {
+            std::string path;
+            if (!reader.ReadString(path)) {
+                return false;
+            }
+            if (path.empty()) {
+                return reader.Fail("empty layout pack path");
+            }
+            settings.layout_packs.push_back(std::move(path));
+        }
+        return !reader.HasFailed();
+    }
+    if (key == "window_size") {
+        static const char* const names[] = {"width", "height"};
+        std::string member;
+        s64 values[2];
+        if (!ReadIntegers(reader, member, "window_size", names, values, 1,
+                          std::numeric_limits<int>::max())) {
+            return false;
+        }
+        settings.window_size = WindowSize{static_cast<int>(values[0]), static_cast<int>(values[1])};
+        return true;
+    }
+    return reader.SkipValue();
+}
+
+static bool ReadScreen(JsonReader& reader, std::string& key, const char* name, LayoutValue first,
+                       CustomLayout::Screen& screen, LayoutExpressions& expressions) {
+    static const char* const names[] = {"left", "top", "right", "bottom"};
+    s64 values[4];
+    if (!ReadIntegers(reader, key, name, names, values, 0, std::numeric_limits<u16>::max(), first,
+                      &expressions)) {
+        return false;
+    }
+    screen = CustomLayout::Screen{
+        static_cast<u16>(values[0]),
+        static_cast<u16>(values[1]),
+        static_cast<u16>(values[2]),
+        static_cast<u16>(values[3]),
+    };
+    return true;
+}
+
+// Reads {"enabled": bool, first: value, second: value}
+static bool ReadWindowOption(JsonReader& reader, std::string& key, const char* name,
+                             const char* first_name, const char* second_name,
+                             LayoutValue first_value, bool& enabled, int& first, int& second,
+                             LayoutExpressions& expressions) {
+    u32 found = 0;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "enabled") {
+            if (!reader.ReadBool(enabled)) {
+                return false;
+            }
+            found |= 1;
+        } else if (key == first_name || key == second_name) {
+            const bool is_first = key == first_name;
+            const LayoutValue value =
+                is_first ? first_value
+                         : static_cast<LayoutValue>(static_cast<std::size_t>(first_value) + 1);
+            s64 integer;
+            if (!ReadLayoutValue(reader, value, std::numeric_limits<int>::min(),
+                                 std::numeric_limits<int>::max(), integer, &expressions)) {
+                return false;
+            }
+            (is_first ? first : second) = static_cast<int>(integer);
+            found |= is_first ? 2 : 4;
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    if (reader.HasFailed()) {
+        return false;
+    }
+    if (found != 7) {
+        return reader.Fail(std::string("missing ") + name + '.' +
+                           ((found & 1) == 0 ? "enabled"
+                                             : ((found & 2) == 0 ? first_name : second_name)));
+    }
+    return true;
+}
+
+static bool ReadLayout(JsonReader& reader, std::string& key, CustomLayout& layout,
+                       LayoutExpressions& expressions, std::string& name) {
+    bool has_top_screen = false;
+    bool has_bottom_screen = false;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "top_screen") {
+            if (!ReadScreen(reader, key, "top_screen", LayoutValue::TopScreenLeft,
+                            layout.top_screen, expressions)) {
+                return false;
+            }
+            has_top_screen = true;
+        } else if (key == "bottom_screen") {
+            if (!ReadScreen(reader, key, "bottom_screen", LayoutValue::BottomScreenLeft,
+                            layout.bottom_screen, expressions)) {
+                return false;
+            }
+            has_bottom_screen = true;
+        } else if (key == "resize_window") {
+            if (!ReadWindowOption(reader, key, "resize_window", "width", "height",
+                                  LayoutValue::ResizeWindowWidth, layout.resize_window.enabled,
+                                  layout.resize_window.width, layout.resize_window.height,
+                                  expressions)) {
+                return false;
+            }
+        } else if (key == "move_window") {
+            if (!ReadWindowOption(reader, key, "move_window", "x", "y", LayoutValue::MoveWindowX,
+                                  layout.move_window.enabled, layout.move_window.x,
+                                  layout.move_window.y, expressions)) {
+                return false;
+            }
+        } else if (key == "name") {
+            if (!reader.ReadString(name)) {
+                return false;
+            }
+        } else if (key == "upright") {
+            bool upright;
+            if (!reader.ReadBool(upright)) {
+                return false;
+            }
+            layout.upright = upright;
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    if (reader.HasFailed()) {
+        return false;
+    }
+    if (!has_top_screen || !has_bottom_screen) {
+        return reader.Fail(!has_top_screen ? "missing top_screen" : "missing bottom_screen");
+    }
+    return true;
+}
+
+static bool ReadLayouts(JsonReader& reader, std::string& key, std::vector<CustomLayout>& layouts,
+                        std::vector<u32>& expression_code, std::vector<char>& names) {
+    // Reused for every layout, so reading layouts without expressions doesn't allocate
+    LayoutExpressions expressions;
+    std::string name;
+    bool done;
+
+    if (!reader.BeginArray()) {
+        return false;
+    }
+    while (reader.NextElement(done) && !done) {
+        CustomLayout layout{};
+        expressions.mask = 0;
+        name.clear();
+        if (!ReadLayout(reader, key, layout, expressions, name)) {
+            return false;
+        }
+        layout.name_offset = static_cast<u32>(names.size());
+        layout.name_length = static_cast<u32>(name.size());
+        names.insert(names.end(), name.begin(), name.end());
+        if (expressions.mask != 0) {
+            // Stored in LayoutValue order no matter the order of the members in the file
+            layout.expression_mask = expressions.mask;
+            layout.expression_code = static_cast<u32>(expression_code.size());
+            for (std::size_t i = 0; i < LAYOUT_VALUE_COUNT; ++i) {
+                if ((expressions.mask & (1u << i)) != 0) {
+                    expression_code.insert(expression_code.end(), expressions.code[i].begin(),
+                                           expressions.code[i].end());
+                }
+            }
+        }
+        layouts.push_back(layout);
+    }
+    return !reader.HasFailed();
+}
+
+static void AppendJsonString(std::string& json, const std::string& value) {
+    static const char hex_digits[] = "0123456789abcdef";
+    json.push_back('"');
+    for (const char c : value) {
+        if (c == '"' || c == '\\') {
+            json.push_back('\\');
+            json.push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            json += "\\u00";
+            json.push_back(hex_digits[(c >> 4) & 0xF]);
+            json.push_back(hex_digits[c & 0xF]);
+        } else {
+            json.push_back(c);
+        }
+    }
+    json.push_back('"');
+}
+
+/**
+ * Reads a settings object, writing layouts straight into the output vector.
+ * options, if given, receives every member except layouts as JSON, for the layout cache.
+ */
+static bool ReadSettings(JsonReader& reader, bool require_layouts, Settings& settings,
+                         std::string* options) {
+    Settings loaded;
+    std::vector<CustomLayout> layouts;
+    std::vector<u32> expression_code;
+    std::vector<char> names;
+    bool has_layouts = false;
+    std::string key;
+    bool done;
+
+    if (options != nullptr) {
+        *options = "{";
+    }
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "layouts") {
+            if (!ReadLayouts(reader, key, layouts, expression_code, names)) {
+                return false;
+            }
+            has_layouts = true;
+            continue;
+        }
+
+        if (options != nullptr) {
+            if (options->size() > 1) {
+                options->push_back(',');
+            }
+            AppendJsonString(*options, key);
+            options->push_back(':');
+            reader.StartCapture(options);
+        }
+        const bool read = ReadOption(reader, key, loaded);
+        reader.StopCapture();
+        if (!read) {
+            return false;
+        }
+    }
+    if (!reader.End()) {
+        return false;
+    }
+    if (require_layouts && !has_layouts) {
+        return reader.Fail("missing layouts");
+    }
+
+    if (options != nullptr) {
+        options->push_back('}');
+    }
+    loaded.layouts.Assign(std::move(layouts), std::move(expression_code), std::move(names));
+    settings = std::move(loaded);
+    return true;
+}
+
+static bool ReadLayoutPack(JsonReader& reader, std::vector<CustomLayout>& layouts,
+                           std::vector<u32>& expression_code, std::vector<char>& names) {
+    bool has_layouts = false;
+    std::string key;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    while (reader.NextMember(key, done) && !done) {
+        if (key == "layouts") {
+            if (!ReadLayouts(reader, key, layouts, expression_code, names)) {
+                return false;
+            }
+            has_layouts = true;
+        } else if (!reader.SkipValue()) {
+            return false;
+        }
+    }
+    if (!reader.End()) {
+        return false;
+    }
+    return has_layouts || reader.Fail("missing layouts");
+}
+
+bool ParseLayoutPack(const std::string& path, std::vector<CustomLayout>& layouts,
+                     std::vector<u32>& expression_code, std::vector<char>& names,
+                     std::string& error) {
+    std::FILE* file = FileUtil::OpenFile(path, "rb");
+    if (file == nullptr) {
+        error = "failed to open " + path;
+        return false;
+    }
+    JsonReader reader(file);
+    const bool read = ReadLayoutPack(reader, layouts, expression_code, names);
+    if (!read) {
+        error = path + ": " + reader.GetError();
+    }
+    std::fclose(file);
+    return read;
+}
+
+static bool LoadSettingsUntimed(const std::string& path, Settings& settings, std::string& error,
+                                const std::atomic<bool>* skip_cache_write) {
+    FileUtil::FileStamp stamp;
+    if (!FileUtil::GetFileStamp(path, stamp)) {
+        error = "failed to open " + path;
+        return false;
+    }
+
+    const std::string cache_path = GetLayoutCachePath(path);
+    if (ReadLayoutCache(cache_path, path, stamp, settings)) {
+        return true;
+    }
+
+    std::FILE* file = FileUtil::OpenFile(path, "rb");
+    if (file == nullptr) {
+        error = "failed to open " + path;
+        return false;
+    }
+    ContentHasher hasher(stamp.size);
+    std::string options;
+    bool read;
+    {
+        JsonReader reader(file, &hasher);
+        read = ReadSettings(reader, true, settings, &options);
+        if (!read) {
+            error = path + ": " + reader.GetError();
+        }
+    }
+    std::fclose(file);
+    if (!read) {
+        return false;
+    }
+
+    // Not being able to write the cache only makes the next start slower. The flag can be set
+    // right after it's checked, see LoadSettings.
+    if (skip_cache_write == nullptr || !skip_cache_write->load(std::memory_order_acquire)) {
+        WriteLayoutCache(cache_path, stamp, hasher.Finish(), settings, options);
+    }
+    return true;
+}
+
+// The trace starts with the settings file, reading it here keeps the frame hook from reading it
+static void ReadTraceSettingsContents(const std::string& path, Settings& settings) {
+    if (settings.trace.enabled && !FileUtil::ReadFile(path, settings.trace_settings_contents)) {
+        std::cerr << "cycle-custom-layouts: failed to read " << path << " for the input trace"
+                  << std::endl;
+    }
+}
+
+bool LoadSettings(const std::string& path, Settings& settings, std::string& error,
+                  const std::atomic<bool>* skip_cache_write) {
+    // Always timed because whether instrumentation is enabled is only known after loading
+    const u64 start = Instrumentation::Now();
+    const bool loaded = LoadSettingsUntimed(path, settings, error, skip_cache_write);
+    if (loaded) {
+        // Packs aren't part of the layout cache, which is only checked against the settings file
+        LoadLayoutPacks(path, settings);
+        settings.programs.Compile(settings.layouts, settings.window_size);
+        ReadTraceSettingsContents(path, settings);
+    }
+    Instrumentation::Record(Instrumentation::Metric::LoadSettings, Instrumentation::Now() - start);
+    return loaded;
+}
+
+bool ParseSettings(const std::string& path, Settings& settings, std::string& error) {
+    std::FILE* file = FileUtil::OpenFile(path, "rb");
+    if (file == nullptr) {
+        error = "failed to open " + path;
+        return false;
+    }
+    JsonReader reader(file);
+    const bool read = ReadSettings(reader, true, settings, nullptr);
+    if (read) {
+        LoadLayoutPacks(path, settings);
+        settings.programs.Compile(settings.layouts, settings.window_size);
+        ReadTraceSettingsContents(path, settings);
+    } else {
+        error = path + ": " + reader.GetError();
+    }
+    std::fclose(file);
+    return read;
+}
+
+bool ParseOptions(const char* data, std::size_t size, Settings& settings, std::string& error) {
+    JsonReader reader(data, size);
+    if (!ReadSettings(reader, false, settings, nullptr)) {
+        error = reader.GetError();
+        return false;
+    }
+    return true;
+}
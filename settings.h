@@ -0,0 +1,321 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "common_types.h"
+#include "file_util.h"
+#include "layout_program.h"
+
+/// The values of a layout that can be expressions, see layout_expression.h
+enum class LayoutValue : u8 {
+    TopScreenLeft,
+    TopScreenTop,
+    TopScreenRight,
+    TopScreenBottom,
+    BottomScreenLeft,
+    BottomScreenTop,
+    BottomScreenRight,
+    BottomScreenBottom,
+    ResizeWindowWidth,
+    ResizeWindowHeight,
+    MoveWindowX,
+    MoveWindowY,
+    Count,
+};
+
+constexpr std::size_t LAYOUT_VALUE_COUNT = static_cast<std::size_t>(LayoutValue::Count);
+
+struct CustomLayout {
+    std::optional<bool> upright;
+    struct Screen {
+        u16 left = 0;
+        u16 top = 0;
+        u16 right = 0;
+        u16 bottom = 0;
+    } top_screen, bottom_screen;
+    struct ResizeWindow {
+        bool enabled = false;
+        int width = 0;
+        int height = 0;
+    } resize_window;
+    struct MoveWindow {
+        bool enabled = false;
+        int x = 0;
+        int y = 0;
+    } move_window;
+    /// Bit i is set if LayoutValue i is an expression. Its field is 0 until the layout is resolved.
+    u16 expression_mask = 0;
+    /// Offset in the table's expression code of the bytecode of the expressions, in LayoutValue
+    /// order
+    u32 expression_code = 0;
+    /// In the table's names, name_length 0 if the layout has no name
+    u32 name_offset = 0;
+    u32 name_length = 0;
+};
+
+// Layouts are stored as-is in the layout cache
+static_assert(std::is_trivially_copyable_v<CustomLayout>);
+
+struct ProfileSettings {
+    /// Profiles that aren't in use are unloaded when the loaded ones use more than this
+    u32 memory_limit_kib = 64 * 1024;
+};
+
+/**
+ * A profile loaded on another thread so the frame hook only swaps its layouts in: the profile in
+ * use when settings were loaded, reloaded with them if its file changed, or a profile being
+ * selected, see ProfileLoader. See ProfileManager::ReloadIfChanged.
+ */
+struct ActiveProfile {
+    /// Empty if the settings file's layouts were in use
+    std::string name;
+    std::string path;
+    /// Of the file the profile's loaded layouts came from if any, then of the file programs was
+    /// loaded from
+    FileUtil::FileStamp stamp;
+    /// Whether programs holds the profile's layouts
+    bool reloaded = false;
+    LayoutPrograms programs;
+};
+
+/// See ControlServer
+struct ControlSocketSettings {
+    bool enabled = false;
+    /// The pipe name on Windows. Relative paths are relative to the vvctre folder.
+    std::string path = "cycle-custom-layouts-plugin.sock";
+};
+
+/// See LiveState
+struct LiveStateSettings {
+    bool enabled = false;
+    /// Relative paths are relative to the vvctre folder
+    std::string path = "cycle-custom-layouts-plugin-live-state.bin";
+};
+
+/// See SwitchCoalescer. A burst ends after settle_frames frames and settle_ms milliseconds without
+/// a switch, both being 0 turns coalescing off.
+struct SwitchingSettings {
+    u32 settle_frames = 0;
+    u32 settle_ms = 0;
+    /// Push the first switch of a burst right away, so single presses aren't delayed
+    bool apply_first_switch_immediately = true;
+};
+
+/// See LayoutTransition
+struct TransitionSettings {
+    enum class Easing : u8 {
+        Linear,
+        EaseIn,
+        EaseOut,
+        EaseInOut,
+    };
+
+    /// 0 switches layouts in one frame
+    u32 frames = 0;
+    Easing easing = Easing::EaseInOut;
+    /// A step taking longer than this makes the transition skip steps, 0 never skips
+    u32 frame_budget_us = 4000;
+};
+
+/// Size of the window layouts are shown in when they don't resize it
+struct WindowSize {
+    int width = 400;
+    int height = 480;
+};
+
+/// Layouts owned by a vector, or used in place from a mapped layout cache.
+class LayoutTable {
+public:
+    void Assign(std::vector<CustomLayout>&& layouts, std::vector<u32>&& expression_code,
+                std::vector<char>&& names);
+    void Assign(FileUtil::MappedFile&& file, const CustomLayout* layouts, std::size_t count,
+                const u32* expression_code, std::size_t expression_code_size, const char* names,
+                std::size_t names_size);
+    void swap(LayoutTable& other) noexcept;
+
+    /// Returns the layout at index with its expressions evaluated.
+    CustomLayout Resolve(std::size_t index, const WindowSize& window_size) const;
+
+    const u32* GetExpressionCode() const {
+        return expression_code;
+    }
+    std::size_t GetExpressionCodeSize() const {
+        return expression_code_size;
+    }
+
+    /// The names of every layout, back to back
+    std::string_view GetNames() const {
+        return std::string_view(names, names_size);
+    }
+    std::string_view GetName(const CustomLayout& layout) const {
+        return std::string_view(names + layout.name_offset, layout.name_length);
+    }
+
+    const CustomLayout& operator[](std::size_t index) const {
+        return data[index];
+    }
+    const CustomLayout* begin() const {
+        return data;
+    }
+    const CustomLayout* end() const {
+        return data + count;
+    }
+    std::size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+
+private:
+    std::vector<CustomLayout> owned;
+    FileUtil::MappedFile mapping;
+    const CustomLayout* data = nullptr;
+    std::size_t count = 0;
+
+    std::vector<u32> owned_expression_code;
+    const u32* expression_code = nullptr;
+    std::size_t expression_code_size = 0;
+
+    std::vector<char> owned_names;
+    const char* names = nullptr;
+    std::size_t names_size = 0;
+};
+
+struct ButtonBinding {
+    enum class Action : u8 {
+        Next,
+        Previous,
+        /// Loads the layout at index layout
+        Select,
+        /// Turns custom layouts off, or back on with the current layout
+        ToggleCustomLayout,
+        /// Loads the first layout of the profile named profile, or of the settings file if it's
+        /// empty
+        SelectProfile,
+    };
+
+    Action action = Action::Next;
+    /// Parameters for vvctre_button_device_new
+    std::string button;
+    u64 layout = 0;
+    std::string profile;
+
+    bool operator==(const ButtonBinding& other) const {
+        return action == other.action && button == other.button && layout == other.layout &&
+               profile == other.profile;
+    }
+};
+
+struct InstrumentationSettings {
+    bool enabled = false;
+    /// Relative paths are relative to the vvctre folder
+    std::string output = "cycle-custom-layouts-plugin-instrumentation.csv";
+    u32 flush_interval_ms = 1000;
+
+    bool operator==(const InstrumentationSettings& other) const {
+        return enabled == other.enabled && output == other.output &&
+               flush_interval_ms == other.flush_interval_ms;
+    }
+    bool operator!=(const InstrumentationSettings& other) const {
+        return !(*this == other);
+    }
+};
+
+/// See InputEngine. vvctre_button_device_get_state is called from a thread when enabled.
+struct InputPollingSettings {
+    bool enabled = false;
+    u32 rate_hz = 1000;
+};
+
+/// See InputTrace
+struct TraceSettings {
+    bool enabled = false;
+    /// Relative paths are relative to the vvctre folder
+    std::string output = "cycle-custom-layouts-plugin-trace.bin";
+};
+
+/// How loading one layout pack went, see LoadLayoutPacks
+struct LayoutPackReport {
+    std::string path;
+    u64 parse_ns = 0;
+    u32 layout_count = 0;
+    /// Layouts that weren't added because an earlier layout is identical
+    u32 duplicate_count = 0;
+    /// Empty if the pack was loaded
+    std::string error;
+};
+
+struct Settings {
+    /// The button setting is the first binding, with Action::Next
+    std::vector<ButtonBinding> bindings;
+    bool load_first_layout_when_vvctre_is_starting_and_emulation_is_starting_for_the_first_time =
+        true;
+    bool watch_settings_file = false;
+    InstrumentationSettings instrumentation;
+    TraceSettings trace;
+    InputPollingSettings input_polling;
+    SwitchingSettings switching;
+    TransitionSettings transitions;
+    ProfileSettings profiles;
+    ControlSocketSettings control_socket;
+    LiveStateSettings live_state;
+    WindowSize window_size;
+    /// Files and folders, ending with a separator, of layouts added after the settings file's.
+    /// Relative paths are relative to the folder of the settings file.
+    std::vector<std::string> layout_packs;
+    std::vector<LayoutPackReport> layout_pack_reports;
+    /// The settings file as it was loaded, for the input trace. Only read when trace.enabled, by
+    /// the thread loading the settings.
+    std::vector<u8> trace_settings_contents;
+    /// Not read from the settings file, set by whoever loaded them
+    ActiveProfile active_profile;
+    /// Not read from the settings file, set by the settings watcher when the load was asked for
+    /// with RequestReload rather than caused by a change of the file
+    bool reload_requested = false;
+    LayoutTable layouts;
+    /// layouts compiled for window_size
+    LayoutPrograms programs;
+};
+
+/// Returns the path of the vvctre folder, with a trailing separator.
+std::string GetVvctreFolder();
+
+/// Returns the path of cycle-custom-layouts-plugin-settings.json in the vvctre folder.
+std::string GetSettingsFilePath();
+std::string GetSettingsFilePath(const std::string& vvctre_folder);
+
+/**
+ * Reads and validates a settings file, adds the layouts of its layout packs, see LoadLayoutPacks,
+ * and compiles the layouts.
+ * The layout cache next to the settings file is used when it's up to date, and written when it
+ * isn't, unless skip_cache_write is set by then. Concurrent loads can both write the cache, each
+ * writes a whole cache of what it read and the last one is kept. A cache that doesn't match the
+ * settings file is rejected when read, so skip_cache_write only saves a useless write.
+ * Never throws. If the file is missing or invalid, settings is left untouched, error describes
+ * the problem, and false is returned.
+ */
+bool LoadSettings(const std::string& path, Settings& settings, std::string& error,
+                  const std::atomic<bool>* skip_cache_write = nullptr);
+
+/// Like LoadSettings, but always parses the file and never touches the layout cache.
+bool ParseSettings(const std::string& path, Settings& settings, std::string& error);
+
+/// Reads the layouts of a layout pack, a file like a settings file that only has layouts, appending
+/// them to the vectors the way a settings file's layouts are read.
+bool ParseLayoutPack(const std::string& path, std::vector<CustomLayout>& layouts,
+                     std::vector<u32>& expression_code, std::vector<char>& names,
+                     std::string& error);
+
+/// Reads everything except the layouts from JSON text. Never throws.
+bool ParseOptions(const char* data, std::size_t size, Settings& settings, std::string& error);
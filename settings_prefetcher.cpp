@@ -0,0 +1,54 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "settings_prefetcher.h"
+
+SettingsPrefetcher::~SettingsPrefetcher() {
+    Join();
+}
+
+void SettingsPrefetcher::Start(const std::string& path) {
+    Join();
+    done = false;
+    abandoned.store(false, std::memory_order_relaxed);
+    thread = std::thread([this, path] {
+        Settings loaded_settings;
+        std::string load_error;
+        const bool load_succeeded = LoadSettings(path, loaded_settings, load_error, &abandoned);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            settings = std::move(loaded_settings);
+            loaded = load_succeeded;
+            error = std::move(load_error);
+            done = true;
+        }
+        condition_variable.notify_one();
+    });
+}
+
+bool SettingsPrefetcher::Take(std::chrono::milliseconds timeout, Settings& settings_,
+                              bool& loaded_, std::string& error_) {
+    if (!thread.joinable()) {
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!condition_variable.wait_for(lock, timeout, [this] { return done; })) {
+            abandoned.store(true, std::memory_order_release);
+            return false;
+        }
+        settings_ = std::move(settings);
+        loaded_ = loaded;
+        error_ = std::move(error);
+    }
+    thread.join();
+    return true;
+}
+
+void SettingsPrefetcher::Join() {
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
@@ -0,0 +1,48 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "settings.h"
+
+/**
+ * Loads the settings file on a worker thread started in PluginLoaded, so the load overlaps with
+ * vvctre's own startup instead of delaying InitialSettingsOpening.
+ */
+class SettingsPrefetcher {
+public:
+    ~SettingsPrefetcher();
+
+    void Start(const std::string& path);
+
+    /**
+     * Waits up to timeout for the load to finish and moves its result out. loaded tells whether
+     * the settings could be loaded, error why not.
+     * Returns false if the load didn't finish in time or wasn't started. The worker then keeps
+     * running and its result is dropped. It skips writing the layout cache unless it was already
+     * writing it, which is safe alongside the caller's own load, see LoadSettings.
+     */
+    bool Take(std::chrono::milliseconds timeout, Settings& settings, bool& loaded,
+              std::string& error);
+
+    /// Waits for the worker thread to exit.
+    void Join();
+
+private:
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+    bool done = false;
+    std::atomic<bool> abandoned{false};
+    Settings settings;
+    bool loaded = false;
+    std::string error;
+};
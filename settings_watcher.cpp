@@ -0,0 +1,241 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "profiles.h"
+#include "settings_watcher.h"
+
+SettingsWatcher::~SettingsWatcher() {
+    Stop();
+    delete loaded_settings.exchange(nullptr);
+    delete retired_settings.exchange(nullptr);
+}
+
+void SettingsWatcher::Start(const std::string& path_) {
+    if (IsRunning()) {
+        return;
+    }
+
+    path = path_;
+
+#ifdef __linux__
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        std::cerr << "cycle-custom-layouts: failed to create the settings watcher pipe"
+                  << std::endl;
+        return;
+    }
+
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd != -1) {
+        // Watch the folder rather than the file because editors often save by replacing the file
+        const std::string::size_type separator = path.find_last_of('/');
+        const std::string folder =
+            separator == std::string::npos ? std::string(".") : path.substr(0, separator);
+        if (inotify_add_watch(inotify_fd, folder.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1) {
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+    }
+    if (inotify_fd == -1) {
+        std::cerr << "cycle-custom-layouts: inotify is unavailable, only the Reload menu item "
+                     "will reload the settings"
+                  << std::endl;
+    }
+#else
+    stop_requested = false;
+    reload_requested = false;
+    FileUtil::GetFileStamp(path, stamp);
+#endif
+
+    thread = std::thread(&SettingsWatcher::Run, this);
+}
+
+void SettingsWatcher::Stop() {
+    if (!IsRunning()) {
+        return;
+    }
+
+#ifdef __linux__
+    const char command = 's';
+    (void)write(wake_pipe[1], &command, 1);
+#else
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop_requested = true;
+    }
+    condition_variable.notify_one();
+#endif
+
+    thread.join();
+
+#ifdef __linux__
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    wake_pipe[0] = wake_pipe[1] = -1;
+#endif
+}
+
+bool SettingsWatcher::IsRunning() const {
+    return thread.joinable();
+}
+
+void SettingsWatcher::RequestReload() {
+    if (!IsRunning()) {
+        return;
+    }
+
+#ifdef __linux__
+    const char command = 'r';
+    (void)write(wake_pipe[1], &command, 1);
+#else
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reload_requested = true;
+    }
+    condition_variable.notify_one();
+#endif
+}
+
+void SettingsWatcher::SetActiveProfile(const ActiveProfile& profile) {
+    std::lock_guard<std::mutex> lock(active_profile_mutex);
+    active_profile.name = profile.name;
+    active_profile.path = profile.path;
+    active_profile.stamp = profile.stamp;
+}
+
+void SettingsWatcher::Retire(Settings* settings) {
+    // Normally the slot is empty because the worker thread empties it after every load
+    delete retired_settings.exchange(settings, std::memory_order_acq_rel);
+}
+
+void SettingsWatcher::Run() {
+    bool stop = false;
+    while (true) {
+        bool requested = false;
+        WaitForChange(stop, requested);
+        if (stop) {
+            return;
+        }
+        Load(requested);
+    }
+}
+
+void SettingsWatcher::Load(bool requested) {
+    delete retired_settings.exchange(nullptr, std::memory_order_acq_rel);
+
+    auto settings = std::make_unique<Settings>();
+    std::string error;
+    if (!LoadSettings(path, *settings, error)) {
+        std::cerr << "cycle-custom-layouts: keeping the current layouts: " << error << std::endl;
+        return;
+    }
+
+    settings->reload_requested = requested;
+    ActiveProfile& profile = settings->active_profile;
+    {
+        std::lock_guard<std::mutex> lock(active_profile_mutex);
+        profile.name = active_profile.name;
+        profile.path = active_profile.path;
+        profile.stamp = active_profile.stamp;
+    }
+    if (!profile.name.empty() && !ProfileManager::ReloadIfChanged(profile, error)) {
+        std::cerr << "cycle-custom-layouts: keeping the layouts of profile " << profile.name
+                  << ": " << error << std::endl;
+    }
+
+    // If the frame hook didn't take the previous settings yet, they are outdated
+    delete loaded_settings.exchange(settings.release(), std::memory_order_acq_rel);
+}
+
+#ifdef __linux__
+
+void SettingsWatcher::WaitForChange(bool& stop, bool& requested) {
+    const std::string::size_type separator = path.find_last_of('/');
+    const std::string file_name =
+        separator == std::string::npos ? path : path.substr(separator + 1);
+
+    pollfd fds[2] = {
+        {wake_pipe[0], POLLIN, 0},
+        {inotify_fd, POLLIN, 0},
+    };
+    const nfds_t fd_count = inotify_fd == -1 ? 1 : 2;
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+
+    while (!changed) {
+        if (poll(fds, fd_count, -1) <= 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char commands[16];
+            const ssize_t count = read(wake_pipe[0], commands, sizeof(commands));
+            for (ssize_t i = 0; i < count; ++i) {
+                if (commands[i] == 's') {
+                    stop = true;
+                    return;
+                }
+                changed = true;
+                requested = true;
+            }
+        }
+
+        if (fd_count == 2 && (fds[1].revents & POLLIN)) {
+            ssize_t length;
+            while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+                for (char* pointer = buffer; pointer < buffer + length;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(pointer);
+                    if (event->len != 0 && file_name == event->name) {
+                        changed = true;
+                    }
+                    pointer += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+    }
+
+    // Editors often save in several steps, wait until the file is quiet before loading it
+    while (poll(&fds[1], fd_count - 1, 100) > 0) {
+        while (read(inotify_fd, buffer, sizeof(buffer)) > 0) {
+        }
+    }
+}
+
+#else
+
+void SettingsWatcher::WaitForChange(bool& stop, bool& requested) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (condition_variable.wait_for(lock, std::chrono::milliseconds(500),
+                                        [this] { return stop_requested || reload_requested; })) {
+            stop = stop_requested;
+            requested = reload_requested;
+            reload_requested = false;
+            return;
+        }
+
+        FileUtil::FileStamp new_stamp;
+        if (FileUtil::GetFileStamp(path, new_stamp) && new_stamp != stamp) {
+            stamp = new_stamp;
+            return;
+        }
+    }
+}
+
+#endif
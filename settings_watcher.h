@@ -0,0 +1,84 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifndef __linux__
+#include <condition_variable>
+#endif
+
+#ifndef __linux__
+#include "file_util.h"
+#endif
+#include "settings.h"
+
+/**
+ * Watches the settings file and loads it on a worker thread whenever it changes (inotify on Linux,
+ * polling elsewhere). Loaded settings are handed over through a single atomic pointer so the frame
+ * hook never waits for, or sees, a partially loaded layout table.
+ * The active profile is reloaded with the settings if its file changed, so using loaded settings
+ * never reads a file.
+ */
+class SettingsWatcher {
+public:
+    ~SettingsWatcher();
+
+    void Start(const std::string& path);
+    void Stop();
+    bool IsRunning() const;
+
+    /**
+     * Asks the worker thread to load the settings file even if it didn't change. The settings it
+     * loads next have reload_requested set. Nothing is handed over if loading fails.
+     */
+    void RequestReload();
+
+    /// Sets the profile the worker thread reloads with the settings, see ActiveProfile.
+    void SetActiveProfile(const ActiveProfile& profile);
+
+    /**
+     * Returns the newest successfully loaded settings, or nullptr if there are none.
+     * The caller owns the returned settings until it gives them back with Retire.
+     */
+    Settings* TakeLoadedSettings() {
+        if (loaded_settings.load(std::memory_order_relaxed) == nullptr) {
+            return nullptr;
+        }
+        return loaded_settings.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    /// Gives settings returned by TakeLoadedSettings back to the worker thread, which frees them.
+    void Retire(Settings* settings);
+
+private:
+    void Run();
+    void Load(bool requested);
+    /// requested tells whether RequestReload was called, rather than the file changing
+    void WaitForChange(bool& stop, bool& requested);
+
+    std::string path;
+    std::thread thread;
+    std::atomic<Settings*> loaded_settings{nullptr};
+    std::atomic<Settings*> retired_settings{nullptr};
+
+    /// Only held to copy the active profile's name, path and stamp
+    std::mutex active_profile_mutex;
+    ActiveProfile active_profile;
+
+#ifdef __linux__
+    int inotify_fd = -1;
+    int wake_pipe[2] = {-1, -1};
+#else
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+    bool stop_requested = false;
+    bool reload_requested = false;
+    FileUtil::FileStamp stamp;
+#endif
+};
@@ -0,0 +1,63 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * A bounded lock-free queue for one producer thread and one consumer thread.
+ * Each side keeps a copy of the other side's index and only reloads it when the copy says the
+ * ring is full or empty, so popping from an empty ring is one atomic load.
+ */
+template <typename T, std::size_t Capacity>
+class SPSCRing {
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    /// Producer only. Returns false if the ring is full.
+    bool TryPush(const T& value) {
+        if (producer.position - producer.other_index == Capacity) {
+            producer.other_index = consumer.index.load(std::memory_order_acquire);
+            if (producer.position - producer.other_index == Capacity) {
+                return false;
+            }
+        }
+        slots[producer.position & (Capacity - 1)] = value;
+        producer.index.store(++producer.position, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer only. Returns false if the ring is empty.
+    bool TryPop(T& value) {
+        if (consumer.position == consumer.other_index) {
+            consumer.other_index = producer.index.load(std::memory_order_acquire);
+            if (consumer.position == consumer.other_index) {
+                return false;
+            }
+        }
+        value = slots[consumer.position & (Capacity - 1)];
+        consumer.index.store(++consumer.position, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // The two sides are on separate cache lines so they don't slow each other down
+    struct alignas(64) Side {
+        /// position, published to the other side
+        std::atomic<std::size_t> index{0};
+        /// Only used by this side
+        std::size_t position = 0;
+        /// This side's copy of the other side's index
+        std::size_t other_index = 0;
+    };
+
+    Side producer;
+    Side consumer;
+    T slots[Capacity];
+};
@@ -32,6 +32,25 @@ std::wstring UTF8ToUTF16W(const std::string& input) {
     return CPToUTF16(CP_UTF8, input);
 }
 
+std::string UTF16ToUTF8(const std::wstring& input) {
+    const auto size = WideCharToMultiByte(CP_UTF8, 0, input.data(), static_cast<int>(input.size()),
+                                          nullptr, 0, nullptr, nullptr);
+
+    if (size == 0) {
+        return "";
+    }
+
+    std::string output(size, '\0');
+
+    if (size != WideCharToMultiByte(CP_UTF8, 0, input.data(), static_cast<int>(input.size()),
+                                    &output[0], static_cast<int>(output.size()), nullptr,
+                                    nullptr)) {
+        output.clear();
+    }
+
+    return output;
+}
+
 } // namespace Common
 
 #endif
@@ -11,6 +11,7 @@
 namespace Common {
 
 std::wstring UTF8ToUTF16W(const std::string& input);
+std::string UTF16ToUTF8(const std::wstring& input);
 
 } // namespace Common
 
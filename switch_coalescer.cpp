@@ -0,0 +1,44 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "instrumentation.h"
+#include "switch_coalescer.h"
+
+void SwitchCoalescer::Configure(const SwitchingSettings& settings_) {
+    settings = settings_;
+    enabled = settings.settle_frames != 0 || settings.settle_ms != 0;
+    Cancel();
+}
+
+bool SwitchCoalescer::OnSwitch() {
+    if (!enabled) {
+        return true;
+    }
+
+    const bool was_in_burst = in_burst;
+    in_burst = true;
+    frames_since_switch = 0;
+    last_switch_time = settings.settle_ms != 0 ? Instrumentation::Now() : 0;
+
+    if (!was_in_burst && settings.apply_first_switch_immediately) {
+        return true;
+    }
+    pending = true;
+    return false;
+}
+
+bool SwitchCoalescer::EndBurst() {
+    ++frames_since_switch;
+    if (frames_since_switch < settings.settle_frames) {
+        return false;
+    }
+    if (settings.settle_ms != 0 &&
+        Instrumentation::Now() - last_switch_time < static_cast<u64>(settings.settle_ms) * 1000000) {
+        return false;
+    }
+    in_burst = false;
+    const bool had_pending = pending;
+    pending = false;
+    return had_pending;
+}
@@ -0,0 +1,49 @@
+// Copyright 2020 Valentin Vanelslande
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common_types.h"
+#include "settings.h"
+
+/**
+ * Decides when switches are pushed to vvctre.
+ * Quick presses form a burst that lasts until no switch happened for the settle window. Only the
+ * last layout of a burst is pushed, when it ends, so reaching a layout a few presses away doesn't
+ * reconfigure the renderer and move the window for each layout on the way.
+ */
+class SwitchCoalescer {
+public:
+    void Configure(const SwitchingSettings& settings);
+
+    /// Called on every switch, returns whether it should be pushed now.
+    bool OnSwitch();
+
+    /// Called every frame before handling input, returns whether the burst ended with a switch
+    /// that wasn't pushed. Outside of bursts this is only a branch.
+    bool OnFrame() {
+        return in_burst && EndBurst();
+    }
+
+    /// Returns whether a switch of the current burst wasn't pushed yet.
+    bool IsPending() const {
+        return pending;
+    }
+
+    /// Forgets the current burst, for when something else pushes a layout.
+    void Cancel() {
+        in_burst = false;
+        pending = false;
+    }
+
+private:
+    bool EndBurst();
+
+    SwitchingSettings settings;
+    bool enabled = false;
+    bool in_burst = false;
+    bool pending = false;
+    u32 frames_since_switch = 0;
+    u64 last_switch_time = 0;
+};